@@ -9,6 +9,7 @@
 #include <istream>
 #include <stdlib.h>
 #include <iterator>
+#include <algorithm>
 #include <glm/glm.hpp>
 #include "rle.h"
 
@@ -77,17 +78,54 @@ public:
   }
 
   void compressAndAddChunk(std::vector<uint8_t>& voxels, uint32_t key) {
-    auto rleVoxels = std::vector<uint8_t>();
-    rle::compress(voxels, rleVoxels);
+    // Compress straight into the buffer
+    size_t maxSize = rle::getMaxCompressedSize(voxels.size());
+    if (dataBufferHead + maxSize > buffer.size()) {
+      buffer.resize(dataBufferHead + maxSize);
+    }
+
+    uint32_t rleSize = (uint32_t)rle::compress(voxels.data(), voxels.size(), buffer.data() + dataBufferHead);
 
     chunkTable.push_back(ChunkTableEntry({
       key,
       dataBufferHead,
-      (uint32_t)rleVoxels.size()
+      rleSize
     }));
 
-    memcpy(buffer.data() + dataBufferHead, rleVoxels.data(), rleVoxels.size());
-    dataBufferHead += rleVoxels.size();
+    dataBufferHead += rleSize;
+  }
+
+  // Same as compressAndAddChunk() for many chunks, compressed on all cores.
+  // The chunks are added in order. Returns false without adding anything unless there's a key for every chunk.
+  bool compressAndAddChunks(const std::vector<std::vector<uint8_t>*>& chunks, const std::vector<uint32_t>& keys) {
+    if (keys.size() != chunks.size()) return false;
+
+    std::vector<const uint8_t*> voxels;
+    std::vector<size_t> sizes;
+    for (std::vector<uint8_t>* chunk : chunks) {
+      voxels.push_back(chunk->data());
+      sizes.push_back(chunk->size());
+    }
+
+    std::vector<std::vector<uint8_t>> rleChunks(chunks.size());
+    int threadCount = std::max((int)std::thread::hardware_concurrency(), 1);
+    rle::compressChunks(voxels.data(), sizes.data(), (int)chunks.size(), rleChunks.data(), threadCount);
+
+    for (size_t i = 0; i < chunks.size(); i++) {
+      if (dataBufferHead + rleChunks[i].size() > buffer.size()) {
+        buffer.resize(dataBufferHead + rleChunks[i].size());
+      }
+
+      chunkTable.push_back(ChunkTableEntry({
+        keys[i],
+        dataBufferHead,
+        (uint32_t)rleChunks[i].size()
+      }));
+
+      memcpy(buffer.data() + dataBufferHead, rleChunks[i].data(), rleChunks[i].size());
+      dataBufferHead += rleChunks[i].size();
+    }
+    return true;
   }
 
   void saveToFile(std::string newLevelName) {
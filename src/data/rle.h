@@ -3,47 +3,149 @@
 
 #include <vector>
 #include <cstring>
+#include <stdint.h>
+#include <atomic>
+#include <thread>
 
-inline void addRleRun(std::vector<uint8_t>& rleVoxels, uint8_t type, uint32_t length) {
-  uint8_t subLength = 0;
-  if (length <= 255) {
-    subLength = length;
-    length = 0;
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RLE_SSE2
+#include <emmintrin.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace rle {
+  // Largest compressed size of count voxels: one run per voxel, plus the empty air run that the data
+  // begins with when the first voxel isn't air
+  inline size_t getMaxCompressedSize(size_t count) {
+    return 2 * count + 2;
   }
-  else {
-    subLength = 255;
-    length -= 255;
+
+  // Writes a run as runs of at most 255 voxels
+  inline uint8_t* writeRun(uint8_t* p, uint8_t type, uint32_t length) {
+    for (; length > 255; length -= 255) {
+      *p++ = type;
+      *p++ = 255;
+    }
+    *p++ = type;
+    *p++ = (uint8_t) length;
+    return p;
   }
 
-  rleVoxels.insert(rleVoxels.end(), { type, subLength });
+  // Bit i is set where voxels[i] differs from voxels[i - 1], for 64 voxels
+  inline uint64_t getRunBoundaries(const uint8_t* voxels) {
+    uint64_t equal = 0;
+#ifdef RLE_SSE2
+    for (int i = 0; i < 4; i++) {
+      const __m128i current = _mm_loadu_si128((const __m128i*) (voxels + i * 16));
+      const __m128i previous = _mm_loadu_si128((const __m128i*) (voxels + i * 16 - 1));
+      equal |= (uint64_t) (uint16_t) _mm_movemask_epi8(_mm_cmpeq_epi8(current, previous)) << (i * 16);
+    }
+#else
+    for (int i = 0; i < 64; i++) {
+      equal |= (uint64_t) (voxels[i] == voxels[i - 1]) << i;
+    }
+#endif
+    return ~equal;
+  }
 
-  if (length > 0) {
-    addRleRun(rleVoxels, type, length);
+  inline int getFirstBoundary(uint64_t boundaries) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, boundaries);
+    return (int) index;
+#else
+    return __builtin_ctzll(boundaries);
+#endif
   }
-}
 
-namespace rle {
-  void compress(std::vector<uint8_t> &voxels, std::vector<uint8_t> &rleVoxels) {
+  // Compresses count voxels into rleVoxels, which has to hold getMaxCompressedSize(count) bytes.
+  // Nothing is shared, so many chunks can be compressed at once. Returns the compressed size.
+  inline size_t compress(const uint8_t* voxels, size_t count, uint8_t* rleVoxels) {
+    uint8_t* p = rleVoxels;
+
+    // The data begins with an air run, even if it's empty
     uint8_t type = 0;
-    uint32_t length = 0;
+    size_t runBegin = 0;
+    if (count && voxels[0]) {
+      p = writeRun(p, 0, 0);
+      type = voxels[0];
+    }
 
-    for (const uint8_t& iType : voxels) {
-      if (type == iType) {
-        length++;
+    // Runs end where a voxel differs from the one before it, found 64 voxels at a time
+    size_t i = 1;
+    for (; i + 64 <= count; i += 64) {
+      for (uint64_t boundaries = getRunBoundaries(voxels + i); boundaries; boundaries &= boundaries - 1) {
+        const size_t boundary = i + getFirstBoundary(boundaries);
+        p = writeRun(p, type, (uint32_t) (boundary - runBegin));
+        type = voxels[boundary];
+        runBegin = boundary;
       }
-      else {
-        addRleRun(rleVoxels, type, length);
+    }
+    for (; i < count; i++) {
+      if (voxels[i] != type) {
+        p = writeRun(p, type, (uint32_t) (i - runBegin));
+        type = voxels[i];
+        runBegin = i;
+      }
+    }
 
-        type = iType;
-        length = 1;
+    p = writeRun(p, type, (uint32_t) (count - runBegin));
+    return p - rleVoxels;
+  }
+
+  // Appends the compressed voxels to rleVoxels
+  void compress(std::vector<uint8_t> &voxels, std::vector<uint8_t> &rleVoxels) {
+    const size_t begin = rleVoxels.size();
+    rleVoxels.resize(begin + getMaxCompressedSize(voxels.size()));
+    rleVoxels.resize(begin + compress(voxels.data(), voxels.size(), rleVoxels.data() + begin));
+  }
+
+  // Compresses chunkCount chunks on threadCount threads, chunk i of chunkSizes[i] voxels into rleChunks[i]
+  void compressChunks(const uint8_t* const* chunks, const size_t* chunkSizes, int chunkCount, std::vector<uint8_t>* rleChunks, int threadCount) {
+    std::atomic<int> next(0);
+    auto work = [&]() {
+      for (int i = next++; i < chunkCount; i = next++) {
+        rleChunks[i].resize(getMaxCompressedSize(chunkSizes[i]));
+        rleChunks[i].resize(compress(chunks[i], chunkSizes[i], rleChunks[i].data()));
       }
+    };
+
+    std::vector<std::thread> threads;
+    for (int i = 1; i < threadCount && i < chunkCount; i++) {
+      threads.emplace_back(work);
+    }
+    work();
+    for (std::thread& thread : threads) {
+      thread.join();
     }
+  }
 
-    addRleRun(rleVoxels, (uint8_t)type, length);
+  // Writes 32 bytes of type, runs shorter than that are overwritten by the runs after them
+  inline void fillShortRun(uint8_t* u_p, uint8_t type) {
+#ifdef RLE_SSE2
+    const __m128i types = _mm_set1_epi8((char) type);
+    _mm_storeu_si128((__m128i*) u_p, types);
+    _mm_storeu_si128((__m128i*) (u_p + 16), types);
+#else
+    const uint64_t types = type * 0x0101010101010101ull;
+    for (int i = 0; i < 32; i += 8) {
+      std::memcpy(u_p + i, &types, 8);
+    }
+#endif
   }
 
-  inline const uint64_t getBitRange(uint8_t low, uint8_t high) {
-    return  ((1ULL << (high - low + 1)) - 1) << low;
+  // Bit i is the parity of bits 0 to i
+  inline uint64_t getPrefixParity(uint64_t bits) {
+    bits ^= bits << 1;
+    bits ^= bits << 2;
+    bits ^= bits << 4;
+    bits ^= bits << 8;
+    bits ^= bits << 16;
+    bits ^= bits << 32;
+    return bits;
   }
 
   void decompressToVoxelsAndOpaqueMask(uint8_t* rleVoxels, int rleSize, uint8_t* voxels, uint64_t* opaqueMask) {
@@ -51,50 +153,56 @@ namespace rle {
     uint8_t* p_end = rleVoxels + rleSize;
     uint8_t* u_p = voxels;
 
+    // Short runs can only be written 32 bytes at a time while that many voxels are left
+    int voxelCount = 0;
+    for (int i = 1; i < rleSize; i += 2) {
+      voxelCount += rleVoxels[i];
+    }
+    const int shortRunEnd = voxelCount - 32;
+
+    // Every run that changes the opacity toggles the bit where it begins. The prefix parity of the toggles
+    // of a word, flipped if the word begins inside an opaque run, are its opaque bits.
     int opaqueMaskIndex = 0;
     int opaqueMaskBitIndex = 0;
+    uint64_t toggles = 0;
+    uint64_t opaque = 0;
+    uint64_t wordBegin = 0;
 
     while (p != p_end) {
       uint8_t type = *p;
       uint8_t len = *(p + 1);
 
-      std::memset(u_p, type, len);
-
-      // Decompress into opaqueMask
-      int remainingLength = len;
-      while (remainingLength) {
-        int remainingBitsInIndex = 64 - opaqueMaskBitIndex;
-        // Partial same int
-        if (remainingLength < remainingBitsInIndex) {
-          if (type) {
-            opaqueMask[opaqueMaskIndex] |= getBitRange(opaqueMaskBitIndex, opaqueMaskBitIndex + remainingLength - 1);
-          }
-          opaqueMaskBitIndex += remainingLength;
-          remainingLength = 0;
-        }
-        // Set n integers
-        else if (remainingLength >= 64 && opaqueMaskBitIndex == 0) {
-          int count = std::floor(remainingLength / 64);
-          if (type) {
-            memset(&opaqueMask[opaqueMaskIndex], (uint64_t)-1, count * sizeof(uint64_t));
-          }
-          opaqueMaskIndex += count;
-          remainingLength -= count * 64;
-        }
-        // Rest of int + left over
-        else if (remainingLength >= remainingBitsInIndex) {
-          if (type) {
-            opaqueMask[opaqueMaskIndex] |= getBitRange(opaqueMaskBitIndex, 63);
-          }
-          remainingLength -= remainingBitsInIndex;
-          opaqueMaskIndex++;
-          opaqueMaskBitIndex = 0;
+      if (len <= 32 && u_p - voxels <= shortRunEnd) {
+        fillShortRun(u_p, type);
+      }
+      else {
+        std::memset(u_p, type, len);
+      }
+
+      const uint64_t runOpaque = 0 - (uint64_t) (type != 0);
+      toggles ^= (runOpaque ^ opaque) & (1ull << opaqueMaskBitIndex);
+      opaque = runOpaque;
+      opaqueMaskBitIndex += len;
+
+      if (opaqueMaskBitIndex >= 64) {
+        opaqueMask[opaqueMaskIndex++] |= getPrefixParity(toggles) ^ wordBegin;
+        opaqueMaskBitIndex -= 64;
+        toggles = 0;
+        wordBegin = opaque;
+
+        // Whole words inside long runs
+        for (; opaqueMaskBitIndex >= 64; opaqueMaskBitIndex -= 64) {
+          opaqueMask[opaqueMaskIndex++] |= opaque;
         }
       }
 
       u_p += len;
       p += 2;
     }
+
+    if (opaqueMaskBitIndex) {
+      opaqueMask[opaqueMaskIndex] |= (getPrefixParity(toggles) ^ wordBegin) & ((1ull << opaqueMaskBitIndex) - 1);
+    }
   }
 };
 
@@ -16,11 +16,17 @@
 
 #define BM_IMPLEMENTATION
 #include "mesher.h"
+#include "rendering/chunk_visibility.h"
+#include "world/automata.h"
 
 void createTestChunk();
+void benchmarkHighQualityMeshing();
 
 const std::string DEMO_LEVEL_FILE = "demo_terrain_96";
 
+// Compares the quad counts of mesh() and meshHighQuality() on the demo level after loading
+const bool BENCHMARK_HIGH_QUALITY_MESHING = false;
+
 const int WINDOW_WIDTH = 1920;
 const int WINDOW_HEIGHT = 1080;
 const bool FULLSCREEN = false;
@@ -118,6 +124,7 @@ enum class MESH_TYPE : int {
   TERRAIN,
   RANDOM,
   CHECKERBOARD,
+  CAVES,
   EMPTY,
   Count
 };
@@ -127,25 +134,27 @@ int mesh_type = (int) MESH_TYPE::SPHERE;
 struct ChunkRenderData {
   glm::ivec3 chunkPos = glm::ivec3(0);
   std::vector<DrawElementsIndirectCommand*> faceDrawCommands = { nullptr, nullptr, nullptr, nullptr, nullptr, nullptr };
-};
-
-struct ThreadData {
-  uint8_t* voxels;
-  MeshData* meshData;
+  FaceBounds faceBounds[6];
 };
 
 struct MeshingResponse {
   ChunkTableEntry* tableEntry;
-  ThreadData* threadData;
+  MeshContext* context;
   long long decompressionDurationUs;
   long long meshingDurationUs;
+  uint16_t faceConnectivity;
 };
 
-MeshData mainThreadMeshData;
+MeshContext mainThreadContext;
+MeshData& mainThreadMeshData = mainThreadContext.meshData;
 ChunkRenderer chunkRenderer;
 std::vector<ChunkRenderData> chunkRenderData;
 ChunkRenderData testChunkRenderData;
+std::vector<uint64_t> testChunkQuads[6];
+std::vector<QuadSpan> testChunkQuadSpans;
 LevelFile levelFile;
+ChunkVisibility chunkVisibility;
+bool caveCulling = true;
 
 void mouse_callback(GLFWwindow* window, double xpos, double ypos) {
   camera->processMouseMovement(xpos - last_x, last_y - ypos);
@@ -183,12 +192,16 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
     }
     createTestChunk();
   }
+
+  else if (key == GLFW_KEY_C && action == GLFW_RELEASE) {
+    caveCulling = !caveCulling;
+    printf("Cave culling: %s\n", caveCulling ? "on" : "off");
+  }
 }
 
 void createTestChunk() {
   uint8_t* voxels = new uint8_t[CS_P3] { 0 };
   memset(voxels, 0, CS_P3);
-  memset(mainThreadMeshData.opaqueMask, 0, CS_P2 * sizeof(uint64_t));
 
   switch (mesh_type) {
     case (int) MESH_TYPE::TERRAIN: {
@@ -207,16 +220,9 @@ void createTestChunk() {
           for (int z = 1; z < CS_P; z++) {
             if (x % 2 == 0 && y % 2 == 0 && z % 2 == 0) {
               voxels[get_zxy_index(x, y, z)] = 1;
-              mainThreadMeshData.opaqueMask[(y * CS_P) + x] |= 1ull << z;
-
               voxels[get_zxy_index(x - 1, y - 1, z)] = 2;
-              mainThreadMeshData.opaqueMask[((y - 1) * CS_P) + (x - 1)] |= 1ull << z;
-
               voxels[get_zxy_index(x - 1, y, z - 1)] = 3;
-              mainThreadMeshData.opaqueMask[(y * CS_P) + (x - 1)] |= 1ull << (z - 1);
-
               voxels[get_zxy_index(x, y - 1, z - 1)] = 4;
-              mainThreadMeshData.opaqueMask[((y - 1) * CS_P) + x] |= 1ull << (z - 1);
             }
           }
         }
@@ -231,7 +237,6 @@ void createTestChunk() {
           for (int z = -r; z < r; z++) {
             if (std::sqrt(x * x + y * y + z * z) < 30.0f) {
               voxels[get_zxy_index(x + r, y + r, z + r)] = 8;
-              mainThreadMeshData.opaqueMask[((y + r) * CS_P) + (x + r)] |= 1ull << (z + r);
             }
           }
         }
@@ -239,12 +244,19 @@ void createTestChunk() {
       break;
     }
 
+    case (int) MESH_TYPE::CAVES: {
+      noise.generateCaves(voxels, mainThreadMeshData.opaqueMask, 30);
+      break;
+    }
+
     case (int) MESH_TYPE::EMPTY: {
       // empty!
       break;
     }
   }
 
+  buildOpaqueMask(voxels, nullptr, mainThreadMeshData.opaqueMask);
+
   {
     int iterations = 1000;
     Timer timer(std::to_string(iterations) + " iterations", true);
@@ -254,45 +266,96 @@ void createTestChunk() {
     }
   }
 
-  for (auto& cmd : testChunkRenderData.faceDrawCommands) {
+#ifdef BM_STATS
+  const MeshStats& stats = mainThreadMeshData.stats;
+  printf("cull: %llu cycles, faces 0-3: %llu cycles, faces 4-5: %llu cycles, heightmap: %llu cycles\n",
+    (unsigned long long) stats.cullCycles, (unsigned long long) stats.mergeCycles[0], (unsigned long long) stats.mergeCycles[1], (unsigned long long) stats.heightmapCycles);
+  printf("bits visited: %llu, type comparisons: %llu, vector growths: %i\n", (unsigned long long) stats.bitsVisited, (unsigned long long) stats.typeComparisons, stats.vectorGrowths);
+  printf("quads per face: %i %i %i %i %i %i, %.2f voxel faces per quad\n",
+    stats.faceQuads[0], stats.faceQuads[1], stats.faceQuads[2], stats.faceQuads[3], stats.faceQuads[4], stats.faceQuads[5], stats.mergeRatio);
+#endif
+
+  glm::ivec3 chunkPos = glm::ivec3(levelFile.getSize() / 2, 1, levelFile.getSize() / 2);
+
+  for (uint32_t i = 0; i <= 5; i++) {
+    auto& cmd = testChunkRenderData.faceDrawCommands[i];
+    auto& previousQuads = testChunkQuads[i];
+    uint64_t* quads = mainThreadMeshData.vertices->data() + mainThreadMeshData.faceVertexBegin[i];
+    int quadCount = mainThreadMeshData.faceVertexLength[i];
+
+    // Only upload the quads that changed if they still fit into the buffer slot of the face
+    if (cmd && quadCount) {
+      diffQuads(previousQuads.data(), previousQuads.size(), quads, quadCount, testChunkQuadSpans);
+      if (chunkRenderer.bufferChanges(*cmd, quads, quadCount, testChunkQuadSpans)) {
+        previousQuads.assign(quads, quads + quadCount);
+        continue;
+      }
+    }
+
     if (cmd) {
       chunkRenderer.removeDrawCommand(cmd);
       delete cmd;
       cmd = nullptr;
     }
-  }
 
-  if (mainThreadMeshData.vertexCount) {
-    uint32_t y = 0;
-    glm::ivec3 chunkPos = glm::ivec3(levelFile.getSize() / 2, 1, levelFile.getSize() / 2);
+    if (quadCount) {
+      uint32_t baseInstance = (i << 24) | (chunkPos.z << 16) | (chunkPos.y << 8) | chunkPos.x;
 
-    for (uint32_t i = 0; i <= 5; i++) {
-      if (mainThreadMeshData.faceVertexLength[i]) {
-        uint32_t baseInstance = (i << 24) | (chunkPos.z << 16) | (chunkPos.y << 8) | chunkPos.x;
+      cmd = chunkRenderer.getDrawCommand(quadCount, baseInstance);
+      chunkRenderer.buffer(*cmd, quads);
+    }
 
-        auto drawCommand = chunkRenderer.getDrawCommand(mainThreadMeshData.faceVertexLength[i], baseInstance);
+    previousQuads.assign(quads, quads + quadCount);
+  }
 
-        testChunkRenderData.faceDrawCommands[i] = drawCommand;
+  printf("vertex count: %i\n", mainThreadMeshData.vertexCount);
+}
 
-        chunkRenderer.buffer(*drawCommand, mainThreadMeshData.vertices->data() + mainThreadMeshData.faceVertexBegin[i]);
-      }
-    }
+void benchmarkHighQualityMeshing() {
+  uint8_t* voxels = new uint8_t[CS_P3] { 0 };
+  long long greedyQuads = 0;
+  long long highQualityQuads = 0;
+  long long greedyDurationUs = 0;
+  long long highQualityDurationUs = 0;
+
+  for (auto& tableEntry : levelFile.chunkTable) {
+    memset(mainThreadMeshData.opaqueMask, 0, CS_P2 * sizeof(uint64_t));
+    rle::decompressToVoxelsAndOpaqueMask(levelFile.buffer.data() + tableEntry.rleDataBegin, tableEntry.rleDataSize, voxels, mainThreadMeshData.opaqueMask);
+
+    Timer greedyTimer("", true);
+    mesh(voxels, mainThreadMeshData);
+    greedyDurationUs += greedyTimer.end();
+    greedyQuads += mainThreadMeshData.vertexCount - 1;
+
+    Timer highQualityTimer("", true);
+    meshHighQuality(voxels, mainThreadMeshData);
+    highQualityDurationUs += highQualityTimer.end();
+    highQualityQuads += mainThreadMeshData.vertexCount - 1;
   }
 
-  printf("vertex count: %i\n", mainThreadMeshData.vertexCount);
+  delete[] voxels;
+
+  printf("\n------------------------------------\n");
+  printf("High quality meshing of %llu chunks:\n", levelFile.chunkTable.size());
+  printf("  mesh(): %llu quads, %lluus avg\n", greedyQuads, greedyDurationUs / levelFile.chunkTable.size());
+  printf("  meshHighQuality(): %llu quads, %lluus avg\n", highQualityQuads, highQualityDurationUs / levelFile.chunkTable.size());
+  printf("  Reduction: %.2f%%\n", 100.0 * (greedyQuads - highQualityQuads) / std::max(greedyQuads, 1ll));
+  printf("------------------------------------\n\n");
 }
 
-auto meshLambda = [](ChunkTableEntry* tableEntry, ThreadData* threadData) -> MeshingResponse {
+auto meshLambda = [](ChunkTableEntry* tableEntry, MeshContext* context) -> MeshingResponse {
   Timer decompressionTimer("", true);
-  memset(threadData->meshData->opaqueMask, 0, CS_P2 * sizeof(uint64_t));
-  rle::decompressToVoxelsAndOpaqueMask(levelFile.buffer.data() + tableEntry->rleDataBegin, tableEntry->rleDataSize, threadData->voxels, threadData->meshData->opaqueMask);
+  memset(context->meshData.opaqueMask, 0, CS_P2 * sizeof(uint64_t));
+  rle::decompressToVoxelsAndOpaqueMask(levelFile.buffer.data() + tableEntry->rleDataBegin, tableEntry->rleDataSize, context->voxels, context->meshData.opaqueMask);
   auto decompressionDurationUs = decompressionTimer.end();
 
   Timer meshingTimer("", true);
-  mesh(threadData->voxels, *threadData->meshData);
+  mesh(context->voxels, context->meshData);
   auto meshingDurationUs = meshingTimer.end();
 
-  return MeshingResponse({ tableEntry, threadData, decompressionDurationUs, meshingDurationUs });
+  uint16_t faceConnectivity = getFaceConnectivity(context->meshData.opaqueMask);
+
+  return MeshingResponse({ tableEntry, context, decompressionDurationUs, meshingDurationUs, faceConnectivity });
 };
 
 int main(int argc, char* argv[]) {
@@ -318,13 +381,6 @@ int main(int argc, char* argv[]) {
     return 1;
   }
 
-  mainThreadMeshData.opaqueMask = new uint64_t[CS_P2] { 0 };
-  mainThreadMeshData.faceMasks = new uint64_t[CS_2 * 6] { 0 };
-  mainThreadMeshData.forwardMerged = new uint8_t[CS_2] { 0 };
-  mainThreadMeshData.rightMerged = new uint8_t[CS] { 0 };
-  mainThreadMeshData.vertices = new std::vector<uint64_t>(10000);
-  mainThreadMeshData.maxVertices = 10000;
-
   chunkRenderer.init();
 
   // Load
@@ -338,26 +394,24 @@ int main(int argc, char* argv[]) {
     long long totalDecompressionDurationUs = 0;
     long long totalMeshBufferingDurationUs = 0;
 
+    // Cave culling searches the level and a layer of open chunks around it
+    glm::ivec3 minChunk = glm::ivec3(255);
+    glm::ivec3 maxChunk = glm::ivec3(0);
+    for (auto& tableEntry : levelFile.chunkTable) {
+      glm::ivec3 chunkPos = parse_xyz_key(tableEntry.key);
+      minChunk = glm::min(minChunk, chunkPos);
+      maxChunk = glm::max(maxChunk, chunkPos);
+    }
+    chunkVisibility.init(minChunk - 1, maxChunk + 1);
+
+    // Mesh contexts for the futures in flight, at most MAX_MESHING_FUTURES are created.
+    // They are freed with the pool once all chunks are loaded.
+    MeshContextPool meshContexts(true);
+
     // Create a temporary thread pool for meshing all chunks on load
     cxxpool::thread_pool threadPool{ (size_t)MESHING_THREADS };
     std::unordered_map<uint32_t, std::future<MeshingResponse>> meshFutures;
 
-    // Create MAX_MESHING_FUTURES instances of ThreadData
-    std::queue<ThreadData*> threadingMeshData = {};
-    for (int i = 0; i < MAX_MESHING_FUTURES; i++) {
-      auto meshData = new MeshData();
-      meshData->opaqueMask = new uint64_t[CS_P2] { 0 };
-      meshData->faceMasks = new uint64_t[CS_2 * 6] { 0 };
-      meshData->forwardMerged = new uint8_t[CS_2] { 0 };
-      meshData->rightMerged = new uint8_t[CS] { 0 };
-      meshData->vertices = new std::vector<uint64_t>(10000);
-      meshData->maxVertices = 10000;
-      auto threadData = new ThreadData();
-      threadData->meshData = meshData;
-      threadData->voxels = new uint8_t[CS_P3] { 0 };
-      threadingMeshData.push(threadData);
-    }
-
     // Create a queue of all chunks
     std::queue<ChunkTableEntry*> meshQueue = {};
     for (auto& tableEntry : levelFile.chunkTable) {
@@ -367,14 +421,13 @@ int main(int argc, char* argv[]) {
     while (meshFutures.size() || meshQueue.size()) {
 
       // Create new futures
-      while (meshFutures.size() < MAX_MESHING_FUTURES && threadingMeshData.size() && meshQueue.size()) {
-        auto threadData = threadingMeshData.front();
-        threadingMeshData.pop();
+      while (meshFutures.size() < MAX_MESHING_FUTURES && meshQueue.size()) {
+        MeshContext* context = meshContexts.acquire();
 
         ChunkTableEntry* entry = meshQueue.front();
         meshQueue.pop();
 
-        meshFutures.emplace(entry->key, threadPool.push(meshLambda, entry, threadData));
+        meshFutures.emplace(entry->key, threadPool.push(meshLambda, entry, context));
       }
 
       // Handle completed futures
@@ -384,12 +437,12 @@ int main(int argc, char* argv[]) {
           finishedMeshKeys.push_back(future_key);
 
           auto response = future.get();
-          threadingMeshData.push(response.threadData);
-
-          auto meshData = *response.threadData->meshData;
+          const MeshData& meshData = response.context->meshData;
           totalDecompressionDurationUs += response.decompressionDurationUs;
           totalMeshingDurationUs += response.meshingDurationUs;
 
+          chunkVisibility.setConnectivity(parse_xyz_key(response.tableEntry->key), response.faceConnectivity);
+
           Timer meshBufferingTimer("", true);
           if (meshData.vertexCount) {
             uint32_t y = 0;
@@ -397,7 +450,7 @@ int main(int argc, char* argv[]) {
             std::vector<DrawElementsIndirectCommand*> commands = { nullptr, nullptr, nullptr, nullptr, nullptr, nullptr };
 
             for (uint32_t i = 0; i <= 5; i++) {
-              if (response.threadData->meshData->faceVertexLength[i]) {
+              if (meshData.faceVertexLength[i]) {
                 uint32_t baseInstance = (i << 24) | (chunkPos.z << 16) | (chunkPos.y << 8) | chunkPos.x;
 
                 auto drawCommand = chunkRenderer.getDrawCommand(meshData.faceVertexLength[i], baseInstance);
@@ -407,9 +460,15 @@ int main(int argc, char* argv[]) {
                 chunkRenderer.buffer(*drawCommand, meshData.vertices->data() + meshData.faceVertexBegin[i]);
               }
             }
-            chunkRenderData.push_back(ChunkRenderData({ chunkPos, commands }));
+            ChunkRenderData renderData = { chunkPos, commands };
+            for (int i = 0; i < 6; i++) {
+              renderData.faceBounds[i] = meshData.faceBounds[i];
+            }
+            chunkRenderData.push_back(renderData);
           }
           totalMeshBufferingDurationUs += meshBufferingTimer.end();
+
+          meshContexts.release(response.context);
         }
       }
 
@@ -418,14 +477,16 @@ int main(int argc, char* argv[]) {
       }
     }
 
-    // TODO: Clean up memory!
-
     printf("\n------------------------------------\n");
     printf("Finished loading %llu chunks:\n", levelFile.chunkTable.size());
     printf("\  Decompression: %lluus avg\n", totalDecompressionDurationUs / levelFile.chunkTable.size());
     printf("\  Meshing: %lluus avg \n", totalMeshingDurationUs / levelFile.chunkTable.size());
     printf("\  Buffering: %lluus avg \n", totalMeshBufferingDurationUs / levelFile.chunkTable.size());
     printf("------------------------------------\n\n");
+
+    if (BENCHMARK_HIGH_QUALITY_MESHING) {
+      benchmarkHighQualityMeshing();
+    }
   }
 
   // Generate terrain
@@ -486,48 +547,30 @@ int main(int argc, char* argv[]) {
       }
     }
 
-    glm::ivec3 cameraChunkPos = glm::floor(camera->position / glm::vec3(CS));
+    if (caveCulling) {
+      chunkVisibility.update(camera->position);
+    }
 
     for (const auto& data : chunkRenderData) {
+      if (caveCulling && !chunkVisibility.isVisible(data.chunkPos)) {
+        continue;
+      }
+
+      glm::ivec3 chunkOrigin = data.chunkPos * CS;
+
       for (int i = 0; i < 6; i++) {
         auto& d = data.faceDrawCommands[i];
         if (d) {
-          switch (i) {
-            case 0:
-              if (cameraChunkPos.y >= data.chunkPos.y) {
-                chunkRenderer.addDrawCommand(*d);
-              }
-              break;
-
-            case 1:
-              if (cameraChunkPos.y <= data.chunkPos.y) {
-                chunkRenderer.addDrawCommand(*d);
-              }
-              break;
-
-            case 2:
-              if (cameraChunkPos.x >= data.chunkPos.x) {
-                chunkRenderer.addDrawCommand(*d);
-              }
-              break;
-
-            case 3:
-              if (cameraChunkPos.x <= data.chunkPos.x) {
-                chunkRenderer.addDrawCommand(*d);
-              }
-              break;
-
-            case 4:
-              if (cameraChunkPos.z >= data.chunkPos.z) {
-                chunkRenderer.addDrawCommand(*d);
-              }
-              break;
-
-            case 5:
-              if (cameraChunkPos.z <= data.chunkPos.z) {
-                chunkRenderer.addDrawCommand(*d);
-              }
-              break;
+          // Faces are only visible from the front of their plane, so a face list is skipped when the camera
+          // is behind all of its layers. Unlike a chunk position check this also culls within the camera's chunk row.
+          const int axis = i < 2 ? 1 : i < 4 ? 0 : 2;
+          const FaceBounds& bounds = data.faceBounds[i];
+          bool visible = i & 1
+            ? camera->position[axis] < chunkOrigin[axis] + bounds.max[axis]
+            : camera->position[axis] > chunkOrigin[axis] + bounds.min[axis];
+
+          if (visible) {
+            chunkRenderer.addDrawCommand(*d);
           }
         }
       }
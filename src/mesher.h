@@ -32,6 +32,9 @@ SOFTWARE.
 //
 //   There are other defines to control the behaviour of the library.
 //   * Define BM_VECTOR with your own vector implementation - otherwise it will use std::vector
+//   * Define BM_NO_HEIGHTMAP_ROUTING to always mesh heightfield chunks with the 3D mesher in mesh()
+//   * Define BM_STATS to record statistics of every mesh call in meshData.stats, see MeshStats.
+//     Without it the statistics don't exist and cost nothing.
 
 #ifndef MESHER_H
 #define MESHER_H
@@ -42,6 +45,16 @@ SOFTWARE.
 #endif
 
 #include <stdint.h>
+#include <stddef.h>
+
+// Column type of super chunks, define BM_UINT128 with your own 128-bit integer type to override
+#ifndef BM_UINT128
+#if defined(__SIZEOF_INT128__)
+#define BM_UINT128 unsigned __int128
+#else
+#define BM_UINT128 Uint128
+#endif
+#endif
 
 // CS = chunk size (max 62)
 static constexpr int CS = 62;
@@ -52,6 +65,33 @@ static constexpr int CS_2 = CS * CS;
 static constexpr int CS_P2 = CS_P * CS_P;
 static constexpr int CS_P3 = CS_P * CS_P * CS_P;
 
+#ifdef BM_STATS
+// Statistics of the last mesh call. Cycles are read with BM_CYCLES(), which is rdtsc on x86.
+struct MeshStats {
+  uint64_t cullCycles = 0;
+  uint64_t mergeCycles[2] = { 0 }; // Faces 0-3 and faces 4-5
+  uint64_t heightmapCycles = 0; // Chunks meshed by meshHeightmap() only record this phase
+  uint64_t bitsVisited = 0; // Face mask bits the merge loops stopped at
+  uint64_t typeComparisons = 0;
+  int vectorGrowths = 0;
+  int visibleFaces = 0; // Voxel faces covered by the quads
+  int faceQuads[6] = { 0 };
+  float mergeRatio = 0.0f; // Voxel faces per quad
+};
+
+#define BM_STATS_ONLY(...) __VA_ARGS__
+#else
+#define BM_STATS_ONLY(...)
+#endif
+
+// Corners of the quads of one face list, in the same chunk coordinates as the quad positions. The quads of
+// a face are flat, so min and max along the face normal are the lowest and highest layer that holds a quad.
+// The bounds of an empty face list are all 0.
+struct FaceBounds {
+  int min[3] = { 0 };
+  int max[3] = { 0 };
+};
+
 struct MeshData {
   uint64_t* faceMasks = nullptr; // CS_2 * 6
   uint64_t* opaqueMask = nullptr; //CS_P2
@@ -62,6 +102,8 @@ struct MeshData {
   int maxVertices = 0;
   int faceVertexBegin[6] = { 0 };
   int faceVertexLength[6] = { 0 };
+  FaceBounds faceBounds[6];
+  BM_STATS_ONLY(MeshStats stats;)
 };
 
 // @param[in] voxels: The input data includes duplicate edge data from neighboring chunks which is used
@@ -69,22 +111,281 @@ struct MeshData {
 // this way so that you can feed the data straight into this algorithm.
 // Input data is ordered in ZXY and is 64^3 which results in a 62^3 mesh.
 //
+// Chunks that are heightfields in meshData.opaqueMask are routed to meshHeightmap(), which leaves
+// meshData.faceMasks untouched.
+//
 // @param[out] meshData The allocated vertices in MeshData with a length of meshData.vertexCount.
 void mesh(const uint8_t* voxels, MeshData& meshData);
 
+// Heightfield chunks are solid from the bottom up to a height per column, with one type for the top
+// voxel of a column and one for the voxels below it. They are meshed in 2D from the heightmap alone,
+// without any 3D occupancy. There are no bottom faces since the chunk below is solid.
+//
+// @param[in] heights: CS_P2 heights ordered (x * CS_P) + z, including the neighbouring columns around the
+// 62x62 inner columns. Padded y in [0, height) is solid, so a height of 0 or 1 leaves the column empty
+// and a height of CS_P continues the column into the chunk above.
+// @param[in] surfaceTypes: CS_P2 types of the top voxel of each column, ordered like heights.
+// @param[in] subsurfaceTypes: CS_P2 types of the voxels below the top voxel, ordered like heights.
+//
+// @param[out] meshData The allocated vertices in MeshData with a length of meshData.vertexCount.
+// Only the vertices are used.
+void meshHeightmap(const uint8_t* heights, const uint8_t* surfaceTypes, const uint8_t* subsurfaceTypes, MeshData& meshData);
+
+// Opaque bits of the voxels in the neighbouring chunks that touch this chunk, CS words per face.
+// Faces are ordered like the mesher faces: +y, -y, +x, -x, +z, -z. A nullptr face is treated as air.
+//
+// +y/-y: one word per x, holding the z column of the neighbour (bits 1-62).
+// +x/-x: one word per y, holding the z column of the neighbour (bits 1-62).
+// +z/-z: one word per y, where bit x + 1 is set if the neighbouring voxel at x is opaque.
+struct ChunkBorders {
+  const uint64_t* faces[6] = { nullptr };
+};
+
+// @param[in] neighbourOpaqueMask: The opaque mask of the neighbour on side `face` of the chunk being meshed.
+// Only the inner 62^3 bits of the neighbour are read.
+//
+// @param[out] border CS words in the layout described by ChunkBorders.
+void getChunkBorder(const uint64_t* neighbourOpaqueMask, int face, uint64_t* border);
+
+// Same as mesh() but without the duplicate edge data. The padding ring of the voxels and of
+// meshData.opaqueMask is never read, instead the padding bits are synthesized from the neighbour
+// borders while culling. This way a chunk can be meshed straight from its own storage without
+// copying in neighbour voxels.
+//
+// @param[in] voxels: 64^3 ZXY like mesh(), only the inner 62^3 voxels have to be valid.
+// @param[in] borders: See ChunkBorders.
+//
+// @param[out] meshData The allocated vertices in MeshData with a length of meshData.vertexCount.
+void meshWithBorders(const uint8_t* voxels, const ChunkBorders& borders, MeshData& meshData);
+
+// Builds the opaque mask that mesh() expects from the voxels, 64 bits per column at a time.
+//
+// @param[in] voxels: 64^3 ZXY, the same data that is passed to mesh().
+// @param[in] opaqueTypes: 256 entry lookup table where a non-zero entry marks a voxel type as opaque.
+// Passing nullptr treats every type except 0 (air) as opaque.
+//
+// @param[out] opaqueMask CS_P2, every column is overwritten.
+void buildOpaqueMask(const uint8_t* voxels, const uint8_t* opaqueTypes, uint64_t* opaqueMask);
+
+// Rebuilds the opaque bits of the column at x, y (0-63) after the voxels in it have been edited.
+void updateOpaqueMaskColumn(const uint8_t* voxels, const uint8_t* opaqueTypes, uint64_t* opaqueMask, int x, int y);
+
+// Tall chunks are CS wide and deep but up to CS_TALL_MAX voxels high (y). Since y is the outermost
+// axis of both the voxels and the opaque mask, a tall chunk is laid out exactly like a regular chunk
+// with more y layers, and the 64-bit columns still run along z.
+//
+// Quads of tall chunks use the spare bits of the second quad word for the high bits of y, width and height,
+// see getQuad(). These bits are always 0 for regular chunks.
+static constexpr int CS_TALL_MAX = 4094;
+
+struct TallMeshData {
+  int height = CS; // 1 - CS_TALL_MAX
+  uint64_t* faceMasks = nullptr; // CS * height * 6
+  uint64_t* opaqueMask = nullptr; // CS_P * (height + 2)
+  uint16_t* forwardMerged = nullptr; // CS_2
+  uint8_t* rightMerged = nullptr; // CS
+  BM_VECTOR<uint64_t>* vertices = nullptr;
+  int vertexCount = 0;
+  int maxVertices = 0;
+  int faceVertexBegin[6] = { 0 };
+  int faceVertexLength[6] = { 0 };
+  FaceBounds faceBounds[6];
+  BM_STATS_ONLY(MeshStats stats;)
+};
+
+// @param[in] voxels: Same as mesh() but CS_P2 * (meshData.height + 2) voxels, ordered in ZXY.
+// The padding layers below and above come from the chunks below and above the column.
+//
+// @param[out] meshData The allocated vertices in TallMeshData with a length of meshData.vertexCount.
+void meshTall(const uint8_t* voxels, TallMeshData& meshData);
+
+// Two word fallback for compilers without a 128-bit integer type
+struct Uint128 {
+  uint64_t low = 0;
+  uint64_t high = 0;
+
+  Uint128() {}
+  Uint128(uint64_t low) : low(low) {}
+  Uint128(uint64_t low, uint64_t high) : low(low), high(high) {}
+
+  Uint128 operator&(const Uint128& other) const { return Uint128(low & other.low, high & other.high); }
+  Uint128 operator|(const Uint128& other) const { return Uint128(low | other.low, high | other.high); }
+  Uint128 operator~() const { return Uint128(~low, ~high); }
+  Uint128& operator&=(const Uint128& other) { low &= other.low; high &= other.high; return *this; }
+  Uint128& operator|=(const Uint128& other) { low |= other.low; high |= other.high; return *this; }
+  explicit operator bool() const { return (low | high) != 0; }
+
+  Uint128 operator<<(int n) const {
+    if (n == 0) return *this;
+    if (n >= 64) return Uint128(0, low << (n - 64));
+    return Uint128(low << n, (high << n) | (low >> (64 - n)));
+  }
+
+  Uint128 operator>>(int n) const {
+    if (n == 0) return *this;
+    if (n >= 64) return Uint128(high >> (n - 64), 0);
+    return Uint128((low >> n) | (high << (64 - n)), high >> n);
+  }
+};
+
+// Super chunks mesh 2x2x2 regular chunks as one unit for distant terrain. They use 128-bit columns,
+// which gives larger quads and fewer draw commands since faces merge across the regular chunk seams.
+// Super chunks stay on the regular chunk grid: a super chunk at chunk position (2i, 2j, 2k) covers
+// the regular chunks up to (2i + 1, 2j + 1, 2k + 1).
+//
+// Quads of super chunks use bits 30 and 31 for the high bits of x and z, see getQuad().
+typedef BM_UINT128 SuperColumn;
+
+static constexpr int SCS = CS * 2;
+static constexpr int SCS_P = SCS + 2;
+static constexpr int SCS_2 = SCS * SCS;
+static constexpr int SCS_P2 = SCS_P * SCS_P;
+static constexpr int SCS_P3 = SCS_P * SCS_P * SCS_P;
+
+struct SuperMeshData {
+  SuperColumn* faceMasks = nullptr; // SCS_2 * 6
+  SuperColumn* opaqueMask = nullptr; // SCS_P2
+  uint8_t* forwardMerged = nullptr; // SCS_2
+  uint8_t* rightMerged = nullptr; // SCS
+  BM_VECTOR<uint64_t>* vertices = nullptr;
+  int vertexCount = 0;
+  int maxVertices = 0;
+  int faceVertexBegin[6] = { 0 };
+  int faceVertexLength[6] = { 0 };
+  FaceBounds faceBounds[6];
+  BM_STATS_ONLY(MeshStats stats;)
+};
+
+// @param[in] voxels: Like mesh() but SCS_P^3 (126^3) voxels ordered in ZXY, including the duplicate edge data.
+//
+// @param[out] meshData The allocated vertices in SuperMeshData with a length of meshData.vertexCount.
+void meshSuper(const uint8_t* voxels, SuperMeshData& meshData);
+
+// Same as buildOpaqueMask() for the SCS_P^3 voxels of a super chunk.
+void buildSuperOpaqueMask(const uint8_t* voxels, const uint8_t* opaqueTypes, SuperColumn* opaqueMask);
+
+// Slower version of mesh() for offline baking of static regions. Each layer of each face is covered
+// with the minimum number of same-type rectangles instead of merging in a fixed scan order, so a face
+// never gets more quads than mesh() would produce for it. Input and output are the same as mesh().
+void meshHighQuality(const uint8_t* voxels, MeshData& meshData);
+
+// A run of changed quads between the previous and the new quads of a face list: previous quads
+// [previousBegin, previousBegin + previousLength) became new quads [begin, begin + length).
+// A span with previousLength == 0 is an insert and one with length == 0 is a remove.
+struct QuadSpan {
+  int previousBegin = 0;
+  int previousLength = 0;
+  int begin = 0;
+  int length = 0;
+};
+
+// Diffs cap the edit script at this many inserted and removed quads, larger changes become one span
+static constexpr int QUAD_DIFF_MAX_EDITS = 128;
+
+// Diffs the quads of a face list against the quads the face had before remeshing, so that only the
+// changed quads have to be uploaded. The quads between the spans are equal and in the same order, but
+// are shifted by the inserts and removes before them.
+//
+// @param[out] spans: Cleared, then filled with the minimal change runs in ascending order.
+void diffQuads(const uint64_t* previousQuads, int previousLength, const uint64_t* quads, int length, BM_VECTOR<QuadSpan>& spans);
+
+// Owns everything a mesh() call needs. The scratch buffers of meshData and the input voxels are carved
+// from one 64 byte aligned arena instead of separate allocations, and freed with the context. With
+// hugePages the arena is rounded up to 2 MB pages and backed by transparent huge pages where the OS
+// supports it, so that all buffers share a single TLB entry.
+class MeshContext {
+public:
+  MeshContext(bool hugePages = false, int maxVertices = 10000);
+  ~MeshContext();
+
+  MeshContext(const MeshContext&) = delete;
+  MeshContext& operator=(const MeshContext&) = delete;
+
+  uint8_t* voxels = nullptr; // CS_P3
+  MeshData meshData;
+
+private:
+  void* arena = nullptr;
+  BM_VECTOR<uint64_t> vertices;
+};
+
+// Hands out MeshContexts for reuse, for example one per meshing job in flight. A context is created
+// when none is free and all of them are freed with the pool. Not thread safe, acquire and release
+// contexts from the thread that hands out the jobs.
+class MeshContextPool {
+public:
+  MeshContextPool(bool hugePages = false) : hugePages(hugePages) {}
+  ~MeshContextPool();
+
+  MeshContextPool(const MeshContextPool&) = delete;
+  MeshContextPool& operator=(const MeshContextPool&) = delete;
+
+  MeshContext* acquire();
+  void release(MeshContext* context);
+
+private:
+  bool hugePages = false;
+  BM_VECTOR<MeshContext*> contexts;
+  BM_VECTOR<MeshContext*> freeContexts;
+};
+
 #endif // MESHER_H
 
 #ifdef BM_IMPLEMENTATION
+#ifndef MESHER_IMPLEMENTATION_H
+#define MESHER_IMPLEMENTATION_H
 
 #ifndef BM_MEMSET
 #define BM_MEMSET memset
 #include <string.h> // memset
 #endif
 
+#include <limits.h> // INT_MAX, INT_MIN
+#include <stdlib.h> // posix_memalign, free
+#include <new> // std::bad_alloc
+
+#if defined(_WIN32)
+#include <malloc.h> // _aligned_malloc
+#elif defined(__linux__)
+#include <sys/mman.h> // madvise
+#endif
+
+#ifdef BM_STATS
+#ifndef BM_CYCLES
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define BM_CYCLES() __rdtsc()
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BM_CYCLES() __rdtsc()
+#else
+#include <chrono>
+#define BM_CYCLES() (uint64_t) std::chrono::steady_clock::now().time_since_epoch().count()
+#endif
+#endif
+
+#define BM_TYPES_EQUAL(meshData, a, b) ((meshData).stats.typeComparisons++, (a) == (b))
+#else
+#define BM_TYPES_EQUAL(meshData, a, b) ((a) == (b))
+#endif
+
+#if defined(__AVX2__)
+#define BM_AVX2
+#include <immintrin.h>
+#elif defined(__SSSE3__)
+#define BM_SSSE3
+#include <tmmintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BM_SSE2
+#include <emmintrin.h>
+#endif
+
+template <int Size = CS>
 static inline const int getAxisIndex(const int axis, const int a, const int b, const int c) {
-  if (axis == 0) return b + (a * CS_P) + (c * CS_P2);
-  else if (axis == 1) return b + (c * CS_P) + (a * CS_P2);
-  else return c + (a * CS_P) + (b * CS_P2);
+  constexpr int P = Size + 2;
+  if (axis == 0) return b + (a * P) + (c * P * P);
+  else if (axis == 1) return b + (c * P) + (a * P * P);
+  else return c + (a * P) + (b * P * P);
 }
 
 static inline const void insertQuad(BM_VECTOR<uint64_t>& vertices, uint64_t quad, int& vertexI, int& maxVertices) {
@@ -98,100 +399,284 @@ static inline const void insertQuad(BM_VECTOR<uint64_t>& vertices, uint64_t quad
   vertexI++;
 }
 
+// Bits 40-57 hold the high bits of y, w and h for tall and super chunks,
+// bits 30 and 31 hold the high bits of x and z for super chunks.
+// Regular chunks leave HighBits off since all of their values fit in 6 bits.
+template <bool HighBits = false>
 static inline const uint64_t getQuad(uint64_t x, uint64_t y, uint64_t z, uint64_t w, uint64_t h, uint64_t type) {
-  return (type << 32) | (h << 24) | (w << 18) | (z << 12) | (y << 6) | x;
+  if (!HighBits) {
+    return (type << 32) | (h << 24) | (w << 18) | (z << 12) | (y << 6) | x;
+  }
+
+  const uint64_t highBits = ((h >> 6) << 52) | ((w >> 6) << 46) | ((y >> 6) << 40) | ((z >> 6) << 31) | ((x >> 6) << 30);
+  return highBits | (type << 32) | ((h & 63) << 24) | ((w & 63) << 18) | ((z & 63) << 12) | ((y & 63) << 6) | (x & 63);
+}
+
+// Only tall and super chunks have values that need the high bits of the quad format
+template <typename Data>
+struct QuadHighBits {
+  static constexpr bool value = false;
+};
+
+template <>
+struct QuadHighBits<TallMeshData> {
+  static constexpr bool value = true;
+};
+
+template <>
+struct QuadHighBits<SuperMeshData> {
+  static constexpr bool value = true;
+};
+
+static inline void resetFaceBounds(FaceBounds& bounds) {
+  for (int axis = 0; axis < 3; axis++) {
+    bounds.min[axis] = INT_MAX;
+    bounds.max[axis] = INT_MIN;
+  }
+}
+
+static inline void growFaceBounds(FaceBounds& bounds, const int minX, const int minY, const int minZ, const int maxX, const int maxY, const int maxZ) {
+  bounds.min[0] = minX < bounds.min[0] ? minX : bounds.min[0];
+  bounds.min[1] = minY < bounds.min[1] ? minY : bounds.min[1];
+  bounds.min[2] = minZ < bounds.min[2] ? minZ : bounds.min[2];
+  bounds.max[0] = maxX > bounds.max[0] ? maxX : bounds.max[0];
+  bounds.max[1] = maxY > bounds.max[1] ? maxY : bounds.max[1];
+  bounds.max[2] = maxZ > bounds.max[2] ? maxZ : bounds.max[2];
+}
+
+static inline void setFaceBounds(FaceBounds& faceBounds, const FaceBounds& bounds, const int faceVertexLength) {
+  faceBounds = faceVertexLength ? bounds : FaceBounds();
 }
 
 constexpr uint64_t P_MASK = ~(1ull << 63 | 1);
 
-void mesh(const uint8_t* voxels, MeshData& meshData) {
-  meshData.vertexCount = 0;
-  int vertexI = 0;
+static inline int getFirstBit(uint64_t bits) {
+  unsigned long bitPos;
+  #ifdef _MSC_VER
+    _BitScanForward64(&bitPos, bits);
+  #else
+    bitPos = __builtin_ctzll(bits);
+  #endif
+  return bitPos;
+}
 
-  uint64_t* opaqueMask = meshData.opaqueMask;
-  uint64_t* faceMasks = meshData.faceMasks;
-  uint8_t* forwardMerged = meshData.forwardMerged;
-  uint8_t* rightMerged = meshData.rightMerged;
+#if defined(__SIZEOF_INT128__)
+static inline int getFirstBit(unsigned __int128 bits) {
+  const uint64_t low = (uint64_t) bits;
+  return low ? getFirstBit(low) : 64 + getFirstBit((uint64_t) (bits >> 64));
+}
+#endif
+
+static inline int getFirstBit(const Uint128& bits) {
+  return bits.low ? getFirstBit(bits.low) : 64 + getFirstBit(bits.high);
+}
+
+static inline int getLastBit(uint64_t bits) {
+  unsigned long bitPos;
+  #ifdef _MSC_VER
+    _BitScanReverse64(&bitPos, bits);
+  #else
+    bitPos = 63 - __builtin_clzll(bits);
+  #endif
+  return bitPos;
+}
+
+#if defined(__SIZEOF_INT128__)
+static inline int getLastBit(unsigned __int128 bits) {
+  const uint64_t high = (uint64_t) (bits >> 64);
+  return high ? 64 + getLastBit(high) : getLastBit((uint64_t) bits);
+}
+#endif
+
+static inline int getLastBit(const Uint128& bits) {
+  return bits.high ? 64 + getLastBit(bits.high) : getLastBit(bits.low);
+}
+
+static inline int getBitCount(uint64_t bits) {
+  #ifdef _MSC_VER
+    return (int) __popcnt64(bits);
+  #else
+    return __builtin_popcountll(bits);
+  #endif
+}
+
+// Expands 8 bits to 8 bytes of 0x00 or 0xFF, bit i to byte i
+static inline uint64_t getByteMask(const uint64_t bits) {
+  const uint64_t spread = ((bits & 0xFF) * 0x0101010101010101ull) & 0x8040201008040201ull;
+  return (((spread + 0x00406070787C7E7Full) & 0x8080808080808080ull) >> 7) * 0xFF;
+}
+
+// Bits 1 - Size of a padded column
+template <typename Column, int Size>
+static inline Column getInnerMask() {
+  return (~Column(0) >> (sizeof(Column) * 8 - Size - 1)) & ~Column(1);
+}
+
+// Hidden face culling, Size is the chunk size along x and z and height is the number of y layers
+template <typename Column, int Size>
+static inline void cullFaces(const Column* opaqueMask, Column* faceMasks, const int height) {
+  constexpr int P = Size + 2;
+  const Column innerMask = getInnerMask<Column, Size>();
+  const int faceSize = Size * height;
+
+  for (int a = 1; a < height + 1; a++) {
+    const int aCS_P = a * P;
+
+    for (int b = 1; b < P - 1; b++) {
+      const Column columnBits = opaqueMask[(a * P) + b] & innerMask;
+      const int baIndex = (b - 1) + (a - 1) * Size;
+      const int abIndex = (a - 1) + (b - 1) * height;
+
+      faceMasks[baIndex + 0 * faceSize] = (columnBits & ~opaqueMask[aCS_P + P + b]) >> 1;
+      faceMasks[baIndex + 1 * faceSize] = (columnBits & ~opaqueMask[aCS_P - P + b]) >> 1;
+
+      faceMasks[abIndex + 2 * faceSize] = (columnBits & ~opaqueMask[aCS_P + (b + 1)]) >> 1;
+      faceMasks[abIndex + 3 * faceSize] = (columnBits & ~opaqueMask[aCS_P + (b - 1)]) >> 1;
+
+      faceMasks[baIndex + 4 * faceSize] = columnBits & ~(opaqueMask[aCS_P + b] >> 1);
+      faceMasks[baIndex + 5 * faceSize] = columnBits & ~(opaqueMask[aCS_P + b] << 1);
+    }
+  }
+}
+
+// Hidden face culling where the padding comes from the neighbour borders instead of opaqueMask
+static inline void cullFacesWithBorders(const uint64_t* opaqueMask, const ChunkBorders& borders, uint64_t* faceMasks) {
+  static const uint64_t emptyBorder[CS] = { 0 };
+
+  const uint64_t* border[6];
+  for (int face = 0; face < 6; face++) {
+    border[face] = borders.faces[face] ? borders.faces[face] : emptyBorder;
+  }
 
-  // Hidden face culling
   for (int a = 1; a < CS_P - 1; a++) {
     const int aCS_P = a * CS_P;
 
+    // Both rows are indexed with b - 1 so that the borders can be used in place of the padding rows
+    const uint64_t* rowAbove = a < CS ? &opaqueMask[aCS_P + CS_P + 1] : border[0];
+    const uint64_t* rowBelow = a > 1 ? &opaqueMask[aCS_P - CS_P + 1] : border[1];
+
+    const uint64_t zAbove = border[4][a - 1];
+    const uint64_t zBelow = border[5][a - 1];
+
     for (int b = 1; b < CS_P - 1; b++) {
       const uint64_t columnBits = opaqueMask[(a * CS_P) + b] & P_MASK;
+      const uint64_t paddedBits = columnBits | (zBelow >> b & 1) | ((zAbove >> b & 1) << 63);
+      const uint64_t rightBits = b < CS ? opaqueMask[aCS_P + (b + 1)] : border[2][a - 1];
+      const uint64_t leftBits = b > 1 ? opaqueMask[aCS_P + (b - 1)] : border[3][a - 1];
       const int baIndex = (b - 1) + (a - 1) * CS;
       const int abIndex = (a - 1) + (b - 1) * CS;
 
-      faceMasks[baIndex + 0 * CS_2] = (columnBits & ~opaqueMask[aCS_P + CS_P + b]) >> 1;
-      faceMasks[baIndex + 1 * CS_2] = (columnBits & ~opaqueMask[aCS_P - CS_P + b]) >> 1;
+      faceMasks[baIndex + 0 * CS_2] = (columnBits & ~rowAbove[b - 1]) >> 1;
+      faceMasks[baIndex + 1 * CS_2] = (columnBits & ~rowBelow[b - 1]) >> 1;
 
-      faceMasks[abIndex + 2 * CS_2] = (columnBits & ~opaqueMask[aCS_P + (b + 1)]) >> 1;
-      faceMasks[abIndex + 3 * CS_2] = (columnBits & ~opaqueMask[aCS_P + (b - 1)]) >> 1;
+      faceMasks[abIndex + 2 * CS_2] = (columnBits & ~rightBits) >> 1;
+      faceMasks[abIndex + 3 * CS_2] = (columnBits & ~leftBits) >> 1;
 
-      faceMasks[baIndex + 4 * CS_2] = columnBits & ~(opaqueMask[aCS_P + b] >> 1);
-      faceMasks[baIndex + 5 * CS_2] = columnBits & ~(opaqueMask[aCS_P + b] << 1);
+      faceMasks[baIndex + 4 * CS_2] = columnBits & ~(paddedBits >> 1);
+      faceMasks[baIndex + 5 * CS_2] = columnBits & ~(paddedBits << 1);
     }
   }
+}
+
+#ifdef BM_STATS
+// Fills in the statistics that follow from the output of a mesh call
+template <typename Data>
+static inline void finishStats(Data& meshData, int maxVerticesBefore) {
+  MeshStats& stats = meshData.stats;
+  for (; maxVerticesBefore < meshData.maxVertices; maxVerticesBefore *= 2) {
+    stats.vectorGrowths++;
+  }
+
+  int quads = 0;
+  for (int face = 0; face < 6; face++) {
+    stats.faceQuads[face] = meshData.faceVertexLength[face];
+    quads += meshData.faceVertexLength[face];
+  }
+  stats.mergeRatio = quads ? (float) stats.visibleFaces / quads : 0.0f;
+}
+#endif
+
+// Greedy face merging, reads only the inner voxels. Data is MeshData, TallMeshData or SuperMeshData,
+// Size is the chunk size along x and z and height is the number of y layers.
+template <typename Column, int Size, typename Data>
+static inline void mergeFaces(const uint8_t* voxels, Data& meshData, const int height) {
+  constexpr bool highBits = QuadHighBits<Data>::value;
+  int vertexI = 0;
+  BM_STATS_ONLY(const int maxVerticesBefore = meshData.maxVertices; uint64_t phaseBegin = BM_CYCLES();)
+
+  const int faceSize = Size * height;
+  const Column* faceMasks = meshData.faceMasks;
+  auto* forwardMerged = meshData.forwardMerged;
+  uint8_t* rightMerged = meshData.rightMerged;
 
   // Greedy meshing faces 0-3
   for (int face = 0; face < 4; face++) {
     const int axis = face / 2;
+    const int layers = axis == 0 ? height : Size;
+    const int forwards = axis == 0 ? Size : height;
 
     const int faceVertexBegin = vertexI;
 
-    for (int layer = 0; layer < CS; layer++) {
-      const int bitsLocation = layer * CS + face * CS_2;
+    // Range of the visible faces in the axes they are walked in, which gives the face bounds
+    Column faceBits = Column(0);
+    int minLayer = layers, maxLayer = 0, minForward = forwards, maxForward = 0;
 
-      for (int forward = 0; forward < CS; forward++) {
-        uint64_t bitsHere = faceMasks[forward + bitsLocation];
-        if (bitsHere == 0) continue;
+    for (int layer = 0; layer < layers; layer++) {
+      const int bitsLocation = layer * forwards + face * faceSize;
 
-        const uint64_t bitsNext = forward + 1 < CS ? faceMasks[(forward + 1) + bitsLocation] : 0;
+      for (int forward = 0; forward < forwards; forward++) {
+        Column bitsHere = faceMasks[forward + bitsLocation];
+        if (!bitsHere) continue;
+
+        faceBits |= bitsHere;
+        minLayer = layer < minLayer ? layer : minLayer;
+        maxLayer = layer;
+        minForward = forward < minForward ? forward : minForward;
+        maxForward = forward > maxForward ? forward : maxForward;
+
+        const Column bitsNext = forward + 1 < forwards ? faceMasks[(forward + 1) + bitsLocation] : Column(0);
 
         uint8_t rightMerged = 1;
         while (bitsHere) {
-          unsigned long bitPos;
-          #ifdef _MSC_VER
-            _BitScanForward64(&bitPos, bitsHere);
-          #else
-            bitPos = __builtin_ctzll(bitsHere);
-          #endif
+          const int bitPos = getFirstBit(bitsHere);
+          BM_STATS_ONLY(meshData.stats.bitsVisited++;)
 
-          const uint8_t type = voxels[getAxisIndex(axis, forward + 1, bitPos + 1, layer + 1)];
-          uint8_t& forwardMergedRef = forwardMerged[bitPos];
+          const uint8_t type = voxels[getAxisIndex<Size>(axis, forward + 1, bitPos + 1, layer + 1)];
+          auto& forwardMergedRef = forwardMerged[bitPos];
 
-          if ((bitsNext >> bitPos & 1) && type == voxels[getAxisIndex(axis, forward + 2, bitPos + 1, layer + 1)]) {
+          if ((bitsNext >> bitPos & 1) && BM_TYPES_EQUAL(meshData, type, voxels[getAxisIndex<Size>(axis, forward + 2, bitPos + 1, layer + 1)])) {
             forwardMergedRef++;
-            bitsHere &= ~(1ull << bitPos);
+            bitsHere &= ~(Column(1) << bitPos);
             continue;
           }
 
-          for (int right = bitPos + 1; right < CS; right++) {
-            if (!(bitsHere >> right & 1) || forwardMergedRef != forwardMerged[right] || type != voxels[getAxisIndex(axis, forward + 1, right + 1, layer + 1)]) break;
+          for (int right = bitPos + 1; right < Size; right++) {
+            if (!(bitsHere >> right & 1) || forwardMergedRef != forwardMerged[right] || !BM_TYPES_EQUAL(meshData, type, voxels[getAxisIndex<Size>(axis, forward + 1, right + 1, layer + 1)])) break;
             forwardMerged[right] = 0;
             rightMerged++;
           }
-          bitsHere &= ~((1ull << (bitPos + rightMerged)) - 1);
+          bitsHere &= ~Column(0) << (bitPos + rightMerged);
 
-          const uint8_t meshFront = forward - forwardMergedRef;
-          const uint8_t meshLeft = bitPos;
-          const uint8_t meshUp = layer + (~face & 1);
+          const int meshFront = forward - forwardMergedRef;
+          const int meshLeft = bitPos;
+          const int meshUp = layer + (~face & 1);
 
-          const uint8_t meshWidth = rightMerged;
-          const uint8_t meshLength = forwardMergedRef + 1;
+          const int meshWidth = rightMerged;
+          const int meshLength = forwardMergedRef + 1;
 
           forwardMergedRef = 0;
           rightMerged = 1;
+          BM_STATS_ONLY(meshData.stats.visibleFaces += meshWidth * meshLength;)
 
           uint64_t quad;
           switch (face) {
           case 0:
           case 1:
-            quad = getQuad(meshFront + (face == 1 ? meshLength : 0), meshUp, meshLeft, meshLength, meshWidth, type);
+            quad = getQuad<highBits>(meshFront + (face == 1 ? meshLength : 0), meshUp, meshLeft, meshLength, meshWidth, type);
             break;
           case 2:
           case 3:
-            quad = getQuad(meshUp, meshFront + (face == 2 ? meshLength : 0), meshLeft, meshLength, meshWidth, type);
+            quad = getQuad<highBits>(meshUp, meshFront + (face == 2 ? meshLength : 0), meshLeft, meshLength, meshWidth, type);
             break;
           }
 
@@ -203,62 +688,84 @@ void mesh(const uint8_t* voxels, MeshData& meshData) {
     const int faceVertexLength = vertexI - faceVertexBegin;
     meshData.faceVertexBegin[face] = faceVertexBegin;
     meshData.faceVertexLength[face] =faceVertexLength;
+
+    FaceBounds& bounds = meshData.faceBounds[face];
+    bounds = FaceBounds();
+    if (faceVertexLength) {
+      const int meshUp = ~face & 1;
+      const int layerAxis = axis == 0 ? 1 : 0;
+      const int forwardAxis = axis == 0 ? 0 : 1;
+      bounds.min[layerAxis] = minLayer + meshUp;
+      bounds.max[layerAxis] = maxLayer + meshUp;
+      bounds.min[forwardAxis] = minForward;
+      bounds.max[forwardAxis] = maxForward + 1;
+      bounds.min[2] = getFirstBit(faceBits);
+      bounds.max[2] = getLastBit(faceBits) + 1;
+    }
   }
 
+  BM_STATS_ONLY(meshData.stats.mergeCycles[0] = BM_CYCLES() - phaseBegin; phaseBegin = BM_CYCLES();)
+
   // Greedy meshing faces 4-5
   for (int face = 4; face < 6; face++) {
     const int axis = face / 2;
 
     const int faceVertexBegin = vertexI;
 
-    for (int forward = 0; forward < CS; forward++) {
-      const int bitsLocation = forward * CS + face * CS_2;
-      const int bitsForwardLocation = (forward + 1) * CS + face * CS_2;
+    Column faceBits = Column(0);
+    int minForward = height, maxForward = 0, minRight = Size, maxRight = 0;
+
+    for (int forward = 0; forward < height; forward++) {
+      const int bitsLocation = forward * Size + face * faceSize;
+      const int bitsForwardLocation = (forward + 1) * Size + face * faceSize;
 
-      for (int right = 0; right < CS; right++) {
-        uint64_t bitsHere = faceMasks[right + bitsLocation];
-        if (bitsHere == 0) continue;
+      for (int right = 0; right < Size; right++) {
+        Column bitsHere = faceMasks[right + bitsLocation];
+        if (!bitsHere) continue;
 
-        const uint64_t bitsForward = forward < CS - 1 ? faceMasks[right + bitsForwardLocation] : 0;
-        const uint64_t bitsRight = right < CS - 1 ? faceMasks[right + 1 + bitsLocation] : 0;
-        const int rightCS = right * CS;
+        faceBits |= bitsHere;
+        minForward = forward < minForward ? forward : minForward;
+        maxForward = forward;
+        minRight = right < minRight ? right : minRight;
+        maxRight = right > maxRight ? right : maxRight;
+
+        const Column bitsForward = forward < height - 1 ? faceMasks[right + bitsForwardLocation] : Column(0);
+        const Column bitsRight = right < Size - 1 ? faceMasks[right + 1 + bitsLocation] : Column(0);
+        const int rightCS = right * Size;
 
         while (bitsHere) {
-          unsigned long bitPos;
-          #ifdef _MSC_VER
-            _BitScanForward64(&bitPos, bitsHere);
-          #else
-            bitPos = __builtin_ctzll(bitsHere);
-          #endif
+          const int bitPos = getFirstBit(bitsHere);
+          BM_STATS_ONLY(meshData.stats.bitsVisited++;)
 
-          bitsHere &= ~(1ull << bitPos);
+          bitsHere &= ~(Column(1) << bitPos);
 
-          const uint8_t type = voxels[getAxisIndex(axis, right + 1, forward + 1, bitPos)];
-          uint8_t& forwardMergedRef = forwardMerged[rightCS + (bitPos - 1)];
+          const uint8_t type = voxels[getAxisIndex<Size>(axis, right + 1, forward + 1, bitPos)];
+          auto& forwardMergedRef = forwardMerged[rightCS + (bitPos - 1)];
           uint8_t& rightMergedRef = rightMerged[bitPos - 1];
           
-          if (rightMergedRef == 0 && (bitsForward >> bitPos & 1) && type == voxels[getAxisIndex(axis, right + 1, forward + 2, bitPos)]) {
+          if (rightMergedRef == 0 && (bitsForward >> bitPos & 1) && BM_TYPES_EQUAL(meshData, type, voxels[getAxisIndex<Size>(axis, right + 1, forward + 2, bitPos)])) {
             forwardMergedRef++;
             continue;
           }
           
-          if ((bitsRight >> bitPos & 1) && forwardMergedRef == forwardMerged[(rightCS + CS) + (bitPos - 1)] && type == voxels[getAxisIndex(axis, right + 2, forward + 1, bitPos)]) {
+          if ((bitsRight >> bitPos & 1) && forwardMergedRef == forwardMerged[(rightCS + Size) + (bitPos - 1)] && BM_TYPES_EQUAL(meshData, type, voxels[getAxisIndex<Size>(axis, right + 2, forward + 1, bitPos)])) {
             forwardMergedRef = 0;
             rightMergedRef++;
             continue;
           }
 
-          const uint8_t meshLeft = right - rightMergedRef;
-          const uint8_t meshFront = forward - forwardMergedRef;
-          const uint8_t meshUp = bitPos - 1 + (~face & 1);
+          const int meshLeft = right - rightMergedRef;
+          const int meshFront = forward - forwardMergedRef;
+          const int meshUp = bitPos - 1 + (~face & 1);
 
-          const uint8_t meshWidth = 1 + rightMergedRef;
-          const uint8_t meshLength = 1 + forwardMergedRef;
+          const int meshWidth = 1 + rightMergedRef;
+          const int meshLength = 1 + forwardMergedRef;
 
           forwardMergedRef = 0;
           rightMergedRef = 0;
+          BM_STATS_ONLY(meshData.stats.visibleFaces += meshWidth * meshLength;)
           
-          const uint64_t quad = getQuad(meshLeft + (face == 4 ? meshWidth : 0), meshFront, meshUp, meshWidth, meshLength, type);
+          const uint64_t quad = getQuad<highBits>(meshLeft + (face == 4 ? meshWidth : 0), meshFront, meshUp, meshWidth, meshLength, type);
 
           insertQuad(*meshData.vertices, quad, vertexI, meshData.maxVertices);
         }
@@ -268,9 +775,1029 @@ void mesh(const uint8_t* voxels, MeshData& meshData) {
     const int faceVertexLength = vertexI - faceVertexBegin;
     meshData.faceVertexBegin[face] = faceVertexBegin;
     meshData.faceVertexLength[face] =faceVertexLength;
+
+    // The bits of faces 4-5 are padded z
+    FaceBounds& bounds = meshData.faceBounds[face];
+    bounds = FaceBounds();
+    if (faceVertexLength) {
+      const int meshUp = ~face & 1;
+      bounds.min[0] = minRight;
+      bounds.max[0] = maxRight + 1;
+      bounds.min[1] = minForward;
+      bounds.max[1] = maxForward + 1;
+      bounds.min[2] = getFirstBit(faceBits) - 1 + meshUp;
+      bounds.max[2] = getLastBit(faceBits) - 1 + meshUp;
+    }
+  }
+
+  meshData.vertexCount = vertexI + 1;
+  BM_STATS_ONLY(meshData.stats.mergeCycles[1] = BM_CYCLES() - phaseBegin; finishStats(meshData, maxVerticesBefore);)
+}
+
+// Bit z is set where the two 64 voxel columns hold the same type
+static inline uint64_t getEqualBytes(const uint8_t* a, const uint8_t* b) {
+  uint64_t bits = 0;
+#if defined(BM_AVX2)
+  for (int i = 0; i < 2; i++) {
+    const __m256i equal = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*) (a + i * 32)), _mm256_loadu_si256((const __m256i*) (b + i * 32)));
+    bits |= (uint64_t) (uint32_t) _mm256_movemask_epi8(equal) << (i * 32);
+  }
+#elif defined(BM_SSSE3) || defined(BM_SSE2)
+  for (int i = 0; i < 4; i++) {
+    const __m128i equal = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*) (a + i * 16)), _mm_loadu_si128((const __m128i*) (b + i * 16)));
+    bits |= (uint64_t) _mm_movemask_epi8(equal) << (i * 16);
+  }
+#else
+  for (int z = 0; z < CS_P; z++) {
+    bits |= (uint64_t) (a[z] == b[z]) << z;
+  }
+#endif
+  return bits;
+}
+
+// Bit z is set where column a holds a larger value than column b
+static inline uint64_t getGreaterBytes(const uint8_t* a, const uint8_t* b) {
+  uint64_t bits = 0;
+#if defined(BM_AVX2)
+  for (int i = 0; i < 2; i++) {
+    const __m256i right = _mm256_loadu_si256((const __m256i*) (b + i * 32));
+    const __m256i notGreater = _mm256_cmpeq_epi8(_mm256_max_epu8(_mm256_loadu_si256((const __m256i*) (a + i * 32)), right), right);
+    bits |= (uint64_t) (uint32_t) ~_mm256_movemask_epi8(notGreater) << (i * 32);
+  }
+#elif defined(BM_SSSE3) || defined(BM_SSE2)
+  for (int i = 0; i < 4; i++) {
+    const __m128i right = _mm_loadu_si128((const __m128i*) (b + i * 16));
+    const __m128i notGreater = _mm_cmpeq_epi8(_mm_max_epu8(_mm_loadu_si128((const __m128i*) (a + i * 16)), right), right);
+    bits |= (uint64_t) (uint16_t) ~_mm_movemask_epi8(notGreater) << (i * 16);
+  }
+#else
+  for (int z = 0; z < CS_P; z++) {
+    bits |= (uint64_t) (a[z] > b[z]) << z;
+  }
+#endif
+  return bits;
+}
+
+// Reads the heightmap of a chunk from its opaque mask. Returns false if the chunk isn't a heightfield,
+// which is when an opaque voxel sits on air or a column has more than one type below its top voxel.
+static inline bool getHeightmap(const uint8_t* voxels, const uint64_t* opaqueMask, uint8_t* heights, uint8_t* surfaceTypes, uint8_t* subsurfaceTypes) {
+  // Every layer of the padded chunk has to be a subset of the layer below
+  for (int y = 1; y < CS_P; y++) {
+    uint64_t overhangs = 0;
+    for (int x = 0; x < CS_P; x++) {
+      overhangs |= opaqueMask[(y * CS_P) + x] & ~opaqueMask[((y - 1) * CS_P) + x];
+    }
+    if (overhangs) return false;
+  }
+
+  // Inner voxels that have an opaque voxel above them have to match the voxel below them
+  for (int y = 2; y < CS_P - 1; y++) {
+    for (int x = 1; x < CS_P - 1; x++) {
+      const int i = (y * CS_P) + x;
+      const uint64_t subsurface = opaqueMask[i] & opaqueMask[i + CS_P] & P_MASK;
+      if (subsurface && (~getEqualBytes(voxels + (i * CS_P), voxels + ((i - CS_P) * CS_P)) & subsurface)) return false;
+    }
+  }
+
+  // The top voxel of a column is where the layer above stops being opaque
+  BM_MEMSET(heights, 0, CS_P2);
+  for (int y = 0; y < CS_P; y++) {
+    for (int x = 0; x < CS_P; x++) {
+      uint64_t tops = opaqueMask[(y * CS_P) + x] & ~(y < CS_P - 1 ? opaqueMask[((y + 1) * CS_P) + x] : 0);
+      while (tops) {
+        const int z = getFirstBit(tops);
+        tops &= tops - 1;
+        heights[(x * CS_P) + z] = y + 1;
+      }
+    }
+  }
+
+  for (int x = 1; x < CS_P - 1; x++) {
+    for (int z = 1; z < CS_P - 1; z++) {
+      const int i = (x * CS_P) + z;
+      surfaceTypes[i] = heights[i] ? voxels[((heights[i] - 1) * CS_P2) + i] : 0;
+      subsurfaceTypes[i] = voxels[CS_P2 + i];
+    }
+  }
+
+  return true;
+}
+
+// Merges the visible faces of one side layer of a heightmap. Row r holds the visible y bits of the
+// column at r, all of type rowTypes[r]. Runs of bits are extended over the following rows that contain
+// them with the same type.
+template <typename Emit>
+static inline void mergeHeightmapSide(uint64_t* rows, const uint8_t* rowTypes, Emit emit) {
+  for (int row = 0; row < CS; row++) {
+    while (rows[row]) {
+      const int begin = getFirstBit(rows[row]);
+      const int length = getFirstBit(~(rows[row] >> begin));
+      const uint64_t run = (~0ull >> (64 - length)) << begin;
+      rows[row] &= ~run;
+
+      int rowsMerged = 1;
+      while (row + rowsMerged < CS && rowTypes[row + rowsMerged] == rowTypes[row] && (rows[row + rowsMerged] & run) == run) {
+        rows[row + rowsMerged] &= ~run;
+        rowsMerged++;
+      }
+
+      emit(row, rowsMerged, begin, length, rowTypes[row]);
+    }
+  }
+}
+
+void meshHeightmap(const uint8_t* heights, const uint8_t* surfaceTypes, const uint8_t* subsurfaceTypes, MeshData& meshData) {
+  int vertexI = 0;
+  BM_STATS_ONLY(meshData.stats = MeshStats(); const int maxVerticesBefore = meshData.maxVertices; const uint64_t heightmapBegin = BM_CYCLES();)
+
+  uint8_t lowest[CS_P];
+  uint8_t highest[CS_P];
+  BM_MEMSET(lowest, 1, CS_P);
+  BM_MEMSET(highest, CS + 1, CS_P);
+
+  // Top faces, merged over the columns with the same height and surface type
+  FaceBounds bounds;
+  resetFaceBounds(bounds);
+  uint64_t merged[CS] = { 0 };
+  for (int x = 0; x < CS; x++) {
+    const uint8_t* row = heights + ((x + 1) * CS_P);
+    uint64_t tops = (getGreaterBytes(row, lowest) & ~getGreaterBytes(row, highest) & P_MASK) >> 1;
+
+    while (tops &= ~merged[x]) {
+      const int z = getFirstBit(tops);
+      const int i = ((x + 1) * CS_P) + (z + 1);
+      const uint8_t height = heights[i];
+      const uint8_t type = surfaceTypes[i];
+
+      auto isSameTop = [&](const int mx, const int mz) {
+        const int j = ((mx + 1) * CS_P) + (mz + 1);
+        return !(merged[mx] >> mz & 1) && heights[j] == height && surfaceTypes[j] == type;
+      };
+
+      int width = 1;
+      while (z + width < CS && isSameTop(x, z + width)) width++;
+
+      int length = 1;
+      for (; x + length < CS; length++) {
+        int right = 0;
+        while (right < width && isSameTop(x + length, z + right)) right++;
+        if (right < width) break;
+      }
+
+      const uint64_t run = (~0ull >> (64 - width)) << z;
+      for (int mx = x; mx < x + length; mx++) {
+        merged[mx] |= run;
+      }
+
+      insertQuad(*meshData.vertices, getQuad<false>(x, height - 1, z, length, width, type), vertexI, meshData.maxVertices);
+      growFaceBounds(bounds, x, height - 1, z, x + length, height - 1, z + width);
+      BM_STATS_ONLY(meshData.stats.visibleFaces += length * width;)
+    }
+  }
+
+  meshData.faceVertexBegin[0] = 0;
+  meshData.faceVertexLength[0] = vertexI;
+  setFaceBounds(meshData.faceBounds[0], bounds, vertexI);
+  meshData.faceVertexBegin[1] = vertexI;
+  meshData.faceVertexLength[1] = 0;
+  meshData.faceBounds[1] = FaceBounds();
+
+  // Side faces, one layer of columns at a time. Rows run along z for faces 2-3 and along x for faces 4-5.
+  // The rows are left empty by mergeHeightmapSide(), so only the rows with visible faces are written.
+  uint64_t candidates[CS];
+  uint64_t surfaceRows[CS] = { 0 };
+  uint64_t subsurfaceRows[CS] = { 0 };
+  uint8_t surfaceRowTypes[CS];
+  uint8_t subsurfaceRowTypes[CS];
+
+  for (int face = 2; face < 6; face++) {
+    const int faceVertexBegin = vertexI;
+    const int neighbourOffset = face == 2 ? CS_P : face == 3 ? -CS_P : face == 4 ? 1 : -1;
+    resetFaceBounds(bounds);
+
+    // Bit row of candidates[layer] is set where a column is higher than its neighbour on this side
+    BM_MEMSET(candidates, 0, sizeof(candidates));
+    for (int x = 0; x < CS; x++) {
+      const uint8_t* row = heights + ((x + 1) * CS_P);
+      uint64_t higher = (getGreaterBytes(row, row + neighbourOffset) & P_MASK) >> 1;
+
+      if (face < 4) {
+        candidates[x] = higher;
+        continue;
+      }
+
+      while (higher) {
+        const int z = getFirstBit(higher);
+        higher &= higher - 1;
+        candidates[z] |= 1ull << x;
+      }
+    }
+
+    for (int layer = 0; layer < CS; layer++) {
+      uint64_t layerBits = 0;
+
+      uint64_t rows = candidates[layer];
+      while (rows) {
+        const int row = getFirstBit(rows);
+        rows &= rows - 1;
+
+        const int i = face < 4 ? ((layer + 1) * CS_P) + (row + 1) : ((row + 1) * CS_P) + (layer + 1);
+        const int height = heights[i] < CS + 1 ? heights[i] : CS + 1;
+        const int neighbourHeight = heights[i + neighbourOffset] > 1 ? heights[i + neighbourOffset] : 1;
+        if (height <= neighbourHeight) continue;
+
+        // Visible inner y in [neighbourHeight - 1, height - 1)
+        const uint64_t bits = (~0ull >> (64 - (height - neighbourHeight))) << (neighbourHeight - 1);
+        const uint64_t surfaceBit = heights[i] <= CS + 1 && surfaceTypes[i] != subsurfaceTypes[i] ? bits & (1ull << (heights[i] - 2)) : 0;
+
+        surfaceRows[row] = surfaceBit;
+        subsurfaceRows[row] = bits & ~surfaceBit;
+        surfaceRowTypes[row] = surfaceTypes[i];
+        subsurfaceRowTypes[row] = subsurfaceTypes[i];
+        layerBits |= bits;
+      }
+
+      if (!layerBits) continue;
+
+      auto emit = [&](const int row, const int rows, const int begin, const int length, const uint8_t type) {
+        const int meshUp = layer + (~face & 1);
+        uint64_t quad;
+        if (face < 4) {
+          quad = getQuad<false>(meshUp, begin + (face == 2 ? length : 0), row, length, rows, type);
+          growFaceBounds(bounds, meshUp, begin, row, meshUp, begin + length, row + rows);
+        }
+        else {
+          quad = getQuad<false>(row + (face == 4 ? rows : 0), begin, meshUp, rows, length, type);
+          growFaceBounds(bounds, row, begin, meshUp, row + rows, begin + length, meshUp);
+        }
+        insertQuad(*meshData.vertices, quad, vertexI, meshData.maxVertices);
+        BM_STATS_ONLY(meshData.stats.visibleFaces += rows * length;)
+      };
+
+      mergeHeightmapSide(subsurfaceRows, subsurfaceRowTypes, emit);
+      mergeHeightmapSide(surfaceRows, surfaceRowTypes, emit);
+    }
+
+    meshData.faceVertexBegin[face] = faceVertexBegin;
+    meshData.faceVertexLength[face] = vertexI - faceVertexBegin;
+    setFaceBounds(meshData.faceBounds[face], bounds, vertexI - faceVertexBegin);
+  }
+
+  meshData.vertexCount = vertexI + 1;
+  BM_STATS_ONLY(meshData.stats.heightmapCycles = BM_CYCLES() - heightmapBegin; finishStats(meshData, maxVerticesBefore);)
+}
+
+void mesh(const uint8_t* voxels, MeshData& meshData) {
+  meshData.vertexCount = 0;
+
+#ifndef BM_NO_HEIGHTMAP_ROUTING
+  uint8_t heights[CS_P2];
+  uint8_t surfaceTypes[CS_P2];
+  uint8_t subsurfaceTypes[CS_P2];
+  if (getHeightmap(voxels, meshData.opaqueMask, heights, surfaceTypes, subsurfaceTypes)) {
+    meshHeightmap(heights, surfaceTypes, subsurfaceTypes, meshData);
+    return;
+  }
+#endif
+
+  BM_STATS_ONLY(meshData.stats = MeshStats(); const uint64_t cullBegin = BM_CYCLES();)
+  cullFaces<uint64_t, CS>(meshData.opaqueMask, meshData.faceMasks, CS);
+  BM_STATS_ONLY(meshData.stats.cullCycles = BM_CYCLES() - cullBegin;)
+  mergeFaces<uint64_t, CS>(voxels, meshData, CS);
+}
+
+void getChunkBorder(const uint64_t* neighbourOpaqueMask, int face, uint64_t* border) {
+  for (int i = 0; i < CS; i++) {
+    switch (face) {
+    case 0:
+      border[i] = neighbourOpaqueMask[CS_P + (i + 1)];
+      break;
+    case 1:
+      border[i] = neighbourOpaqueMask[(CS * CS_P) + (i + 1)];
+      break;
+    case 2:
+      border[i] = neighbourOpaqueMask[((i + 1) * CS_P) + 1];
+      break;
+    case 3:
+      border[i] = neighbourOpaqueMask[((i + 1) * CS_P) + CS];
+      break;
+    case 4:
+    case 5: {
+      const int z = face == 4 ? 1 : CS;
+      const uint64_t* row = &neighbourOpaqueMask[(i + 1) * CS_P];
+      uint64_t bits = 0;
+      for (int b = 1; b < CS_P - 1; b++) {
+        bits |= (row[b] >> z & 1) << b;
+      }
+      border[i] = bits;
+      break;
+    }
+    }
+  }
+}
+
+void meshWithBorders(const uint8_t* voxels, const ChunkBorders& borders, MeshData& meshData) {
+  meshData.vertexCount = 0;
+
+  BM_STATS_ONLY(meshData.stats = MeshStats(); const uint64_t cullBegin = BM_CYCLES();)
+  cullFacesWithBorders(meshData.opaqueMask, borders, meshData.faceMasks);
+  BM_STATS_ONLY(meshData.stats.cullCycles = BM_CYCLES() - cullBegin;)
+  mergeFaces<uint64_t, CS>(voxels, meshData, CS);
+}
+
+void meshTall(const uint8_t* voxels, TallMeshData& meshData) {
+  meshData.vertexCount = 0;
+
+  BM_STATS_ONLY(meshData.stats = MeshStats(); const uint64_t cullBegin = BM_CYCLES();)
+  cullFaces<uint64_t, CS>(meshData.opaqueMask, meshData.faceMasks, meshData.height);
+  BM_STATS_ONLY(meshData.stats.cullCycles = BM_CYCLES() - cullBegin;)
+  mergeFaces<uint64_t, CS>(voxels, meshData, meshData.height);
+}
+
+void meshSuper(const uint8_t* voxels, SuperMeshData& meshData) {
+  meshData.vertexCount = 0;
+
+  BM_STATS_ONLY(meshData.stats = MeshStats(); const uint64_t cullBegin = BM_CYCLES();)
+  cullFaces<SuperColumn, SCS>(meshData.opaqueMask, meshData.faceMasks, SCS);
+  BM_STATS_ONLY(meshData.stats.cullCycles = BM_CYCLES() - cullBegin;)
+  mergeFaces<SuperColumn, SCS>(voxels, meshData, SCS);
+}
+
+// The opacity table split on the high nibble of the voxel type so that it can be looked up with
+// byte shuffles: bit (type >> 4) & 7 of lowTable[type & 15] / highTable[type & 15] is the opacity of type.
+struct OpacityNibbleTables {
+  alignas(16) uint8_t lowTable[16];
+  alignas(16) uint8_t highTable[16];
+};
+
+static inline void getOpacityNibbleTables(const uint8_t* opaqueTypes, OpacityNibbleTables& tables) {
+  BM_MEMSET(&tables, 0, sizeof(tables));
+  for (int type = 0; type < 256; type++) {
+    if (!opaqueTypes[type]) continue;
+    uint8_t* table = type < 128 ? tables.lowTable : tables.highTable;
+    table[type & 15] |= 1 << ((type >> 4) & 7);
+  }
+}
+
+static inline uint64_t getOpaqueColumnScalar(const uint8_t* column, const uint8_t* opaqueTypes) {
+  uint64_t bits = 0;
+  for (int z = 0; z < CS_P; z++) {
+    if (opaqueTypes ? opaqueTypes[column[z]] : column[z]) {
+      bits |= 1ull << z;
+    }
+  }
+  return bits;
+}
+
+#if defined(BM_AVX2)
+static inline uint64_t getOpaqueColumn(const uint8_t* column) {
+  const __m256i zero = _mm256_setzero_si256();
+  const uint32_t air0 = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*) column), zero));
+  const uint32_t air1 = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*) (column + 32)), zero));
+  return ~((uint64_t) air1 << 32 | air0);
+}
+
+static inline uint64_t getOpaqueColumn(const uint8_t* column, const OpacityNibbleTables& tables) {
+  const __m256i lowTable = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i*) tables.lowTable));
+  const __m256i highTable = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i*) tables.highTable));
+  const __m256i bitTable = _mm256_setr_epi8(
+    1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128,
+    1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128
+  );
+  const __m256i nibbleMask = _mm256_set1_epi8(15);
+  const __m256i zeroLane = _mm256_set1_epi8(-128);
+  const __m256i zero = _mm256_setzero_si256();
+
+  uint64_t bits = 0;
+  for (int i = 0; i < 2; i++) {
+    const __m256i types = _mm256_loadu_si256((const __m256i*) (column + i * 32));
+    const __m256i low = _mm256_and_si256(types, nibbleMask);
+    const __m256i high = _mm256_and_si256(_mm256_srli_epi16(types, 4), nibbleMask);
+
+    // Lanes with the high bit set in the shuffle index read zero, so each table only answers for its own half
+    const __m256i isHighHalf = _mm256_cmpgt_epi8(high, _mm256_set1_epi8(7));
+    const __m256i lowIndex = _mm256_or_si256(low, _mm256_and_si256(isHighHalf, zeroLane));
+    const __m256i highIndex = _mm256_or_si256(low, _mm256_andnot_si256(isHighHalf, zeroLane));
+    const __m256i row = _mm256_or_si256(_mm256_shuffle_epi8(lowTable, lowIndex), _mm256_shuffle_epi8(highTable, highIndex));
+
+    const __m256i opacity = _mm256_and_si256(row, _mm256_shuffle_epi8(bitTable, high));
+    const uint32_t transparent = _mm256_movemask_epi8(_mm256_cmpeq_epi8(opacity, zero));
+    bits |= (uint64_t) (uint32_t) ~transparent << (i * 32);
+  }
+  return bits;
+}
+#elif defined(BM_SSSE3) || defined(BM_SSE2)
+static inline uint64_t getOpaqueColumn(const uint8_t* column) {
+  const __m128i zero = _mm_setzero_si128();
+  uint64_t air = 0;
+  for (int i = 0; i < 4; i++) {
+    const __m128i types = _mm_loadu_si128((const __m128i*) (column + i * 16));
+    air |= (uint64_t) _mm_movemask_epi8(_mm_cmpeq_epi8(types, zero)) << (i * 16);
+  }
+  return ~air;
+}
+
+#if defined(BM_SSSE3)
+static inline uint64_t getOpaqueColumn(const uint8_t* column, const OpacityNibbleTables& tables) {
+  const __m128i lowTable = _mm_load_si128((const __m128i*) tables.lowTable);
+  const __m128i highTable = _mm_load_si128((const __m128i*) tables.highTable);
+  const __m128i bitTable = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128);
+  const __m128i nibbleMask = _mm_set1_epi8(15);
+  const __m128i zeroLane = _mm_set1_epi8(-128);
+  const __m128i zero = _mm_setzero_si128();
+
+  uint64_t transparent = 0;
+  for (int i = 0; i < 4; i++) {
+    const __m128i types = _mm_loadu_si128((const __m128i*) (column + i * 16));
+    const __m128i low = _mm_and_si128(types, nibbleMask);
+    const __m128i high = _mm_and_si128(_mm_srli_epi16(types, 4), nibbleMask);
+
+    // Lanes with the high bit set in the shuffle index read zero, so each table only answers for its own half
+    const __m128i isHighHalf = _mm_cmpgt_epi8(high, _mm_set1_epi8(7));
+    const __m128i lowIndex = _mm_or_si128(low, _mm_and_si128(isHighHalf, zeroLane));
+    const __m128i highIndex = _mm_or_si128(low, _mm_andnot_si128(isHighHalf, zeroLane));
+    const __m128i row = _mm_or_si128(_mm_shuffle_epi8(lowTable, lowIndex), _mm_shuffle_epi8(highTable, highIndex));
+
+    const __m128i opacity = _mm_and_si128(row, _mm_shuffle_epi8(bitTable, high));
+    transparent |= (uint64_t) _mm_movemask_epi8(_mm_cmpeq_epi8(opacity, zero)) << (i * 16);
+  }
+  return ~transparent;
+}
+#endif
+#else
+static inline uint64_t getOpaqueColumn(const uint8_t* column) {
+  return getOpaqueColumnScalar(column, nullptr);
+}
+#endif
+
+void buildOpaqueMask(const uint8_t* voxels, const uint8_t* opaqueTypes, uint64_t* opaqueMask) {
+  if (!opaqueTypes) {
+    for (int i = 0; i < CS_P2; i++) {
+      opaqueMask[i] = getOpaqueColumn(voxels + i * CS_P);
+    }
+    return;
+  }
+
+#if defined(BM_AVX2) || defined(BM_SSSE3)
+  OpacityNibbleTables tables;
+  getOpacityNibbleTables(opaqueTypes, tables);
+
+  for (int i = 0; i < CS_P2; i++) {
+    opaqueMask[i] = getOpaqueColumn(voxels + i * CS_P, tables);
+  }
+#else
+  for (int i = 0; i < CS_P2; i++) {
+    opaqueMask[i] = getOpaqueColumnScalar(voxels + i * CS_P, opaqueTypes);
+  }
+#endif
+}
+
+void updateOpaqueMaskColumn(const uint8_t* voxels, const uint8_t* opaqueTypes, uint64_t* opaqueMask, int x, int y) {
+  const int i = (y * CS_P) + x;
+
+  // A single column isn't worth building the shuffle tables for
+  opaqueMask[i] = opaqueTypes ? getOpaqueColumnScalar(voxels + i * CS_P, opaqueTypes) : getOpaqueColumn(voxels + i * CS_P);
+}
+
+void buildSuperOpaqueMask(const uint8_t* voxels, const uint8_t* opaqueTypes, SuperColumn* opaqueMask) {
+  for (int i = 0; i < SCS_P2; i++) {
+    const uint8_t* column = voxels + i * SCS_P;
+
+    // The upper 62 voxels don't fill a full SIMD column
+    uint64_t high = 0;
+    for (int z = 64; z < SCS_P; z++) {
+      if (opaqueTypes ? opaqueTypes[column[z]] : column[z]) {
+        high |= 1ull << (z - 64);
+      }
+    }
+
+    const uint64_t low = opaqueTypes ? getOpaqueColumnScalar(column, opaqueTypes) : getOpaqueColumn(column);
+    opaqueMask[i] = (SuperColumn(high) << 64) | SuperColumn(low);
+  }
+}
+
+// A rectangle of faces in one layer, rows run along the forward axis and columns along the right axis
+struct LayerRect {
+  int row, col, rows, cols;
+};
+
+// A cut between two reflex corners on the same grid line, line is the row line (or column line when transposed)
+// and the chord runs from begin to end on it
+struct LayerChord {
+  int line, begin, end;
+};
+
+struct RectCoverScratch {
+  BM_VECTOR<LayerChord> rowChords;
+  BM_VECTOR<LayerChord> colChords;
+  BM_VECTOR<int> adjacency;
+  BM_VECTOR<int> adjacencyBegin;
+  BM_VECTOR<int> matchRow;
+  BM_VECTOR<int> matchCol;
+  BM_VECTOR<uint8_t> visited;
+  BM_VECTOR<uint8_t> rowReached;
+};
+
+// Reflex corners on row line i (between rows i - 1 and i), bit j is the corner at column line j.
+// Corners are reflex when exactly 3 of the 4 cells around them are set.
+static inline void getReflexCorners(uint64_t above, uint64_t below, uint64_t& extendRight, uint64_t& extendLeft) {
+  const uint64_t aboveLeft = above << 1;
+  const uint64_t belowLeft = below << 1;
+  const uint64_t innerLines = ((1ull << CS) - 1) & ~1ull;
+
+  extendRight = ((~aboveLeft & above & belowLeft & below) | (aboveLeft & above & ~belowLeft & below)) & innerLines;
+  extendLeft = ((aboveLeft & ~above & belowLeft & below) | (aboveLeft & above & belowLeft & ~below)) & innerLines;
+}
+
+// Chords along the row lines: from a corner that extends right to the next corner that extends left,
+// with set cells on both sides of the whole chord
+static inline void getLayerChords(const uint64_t* rows, BM_VECTOR<LayerChord>& chords) {
+  for (int line = 1; line < CS; line++) {
+    uint64_t extendRight, extendLeft;
+    getReflexCorners(rows[line - 1], rows[line], extendRight, extendLeft);
+
+    const uint64_t bothSides = rows[line - 1] & rows[line];
+    while (extendRight) {
+      const int begin = getFirstBit(extendRight);
+      extendRight &= extendRight - 1;
+
+      const int end = begin + getFirstBit(~(bothSides >> begin));
+      if (extendLeft >> end & 1) {
+        chords.push_back({ line, begin, end });
+      }
+    }
+  }
+}
+
+static inline bool findAugmentingPath(int rowChord, RectCoverScratch& scratch) {
+  for (int i = scratch.adjacencyBegin[rowChord]; i < scratch.adjacencyBegin[rowChord + 1]; i++) {
+    const int colChord = scratch.adjacency[i];
+    if (scratch.visited[colChord]) continue;
+    scratch.visited[colChord] = 1;
+
+    if (scratch.matchCol[colChord] < 0 || findAugmentingPath(scratch.matchCol[colChord], scratch)) {
+      scratch.matchRow[rowChord] = colChord;
+      scratch.matchCol[colChord] = rowChord;
+      return true;
+    }
+  }
+  return false;
+}
+
+// Marks the row chords reachable from unmatched row chords through alternating paths (König's theorem)
+static inline void markAlternating(int rowChord, RectCoverScratch& scratch) {
+  scratch.rowReached[rowChord] = 1;
+  for (int i = scratch.adjacencyBegin[rowChord]; i < scratch.adjacencyBegin[rowChord + 1]; i++) {
+    const int colChord = scratch.adjacency[i];
+    if (scratch.visited[colChord]) continue;
+    scratch.visited[colChord] = 1;
+
+    const int next = scratch.matchCol[colChord];
+    if (next >= 0 && !scratch.rowReached[next]) {
+      markAlternating(next, scratch);
+    }
+  }
+}
+
+// Minimum rectangle partition of the set bits of rows. The largest set of non-crossing chords between
+// reflex corners is found with a bipartite matching, the grid is cut along those chords, and every
+// remaining reflex corner is resolved by extending a cut from it until it meets another cut or the boundary.
+// See Lipski et al., "On two-dimensional data organization II".
+static inline void coverExact(const uint64_t* rows, BM_VECTOR<LayerRect>& rects, RectCoverScratch& scratch) {
+  uint64_t columns[CS] = { 0 };
+  for (int row = 0; row < CS; row++) {
+    uint64_t bits = rows[row];
+    while (bits) {
+      const int col = getFirstBit(bits);
+      bits &= bits - 1;
+      columns[col] |= 1ull << row;
+    }
+  }
+
+  scratch.rowChords.clear();
+  scratch.colChords.clear();
+  getLayerChords(rows, scratch.rowChords);
+  getLayerChords(columns, scratch.colChords);
+
+  const int rowChordCount = scratch.rowChords.size();
+  const int colChordCount = scratch.colChords.size();
+
+  // Chords cross when they intersect or share a corner
+  scratch.adjacency.clear();
+  scratch.adjacencyBegin.clear();
+  for (int r = 0; r < rowChordCount; r++) {
+    const LayerChord& rowChord = scratch.rowChords[r];
+    scratch.adjacencyBegin.push_back(scratch.adjacency.size());
+    for (int c = 0; c < colChordCount; c++) {
+      const LayerChord& colChord = scratch.colChords[c];
+      if (colChord.line >= rowChord.begin && colChord.line <= rowChord.end && rowChord.line >= colChord.begin && rowChord.line <= colChord.end) {
+        scratch.adjacency.push_back(c);
+      }
+    }
+  }
+  scratch.adjacencyBegin.push_back(scratch.adjacency.size());
+
+  scratch.matchRow.assign(rowChordCount, -1);
+  scratch.matchCol.assign(colChordCount, -1);
+  for (int r = 0; r < rowChordCount; r++) {
+    scratch.visited.assign(colChordCount, 0);
+    findAugmentingPath(r, scratch);
+  }
+
+  // The largest set of non-crossing chords is the complement of the minimum vertex cover:
+  // reached row chords plus unreached column chords
+  scratch.rowReached.assign(rowChordCount, 0);
+  scratch.visited.assign(colChordCount, 0);
+  for (int r = 0; r < rowChordCount; r++) {
+    if (scratch.matchRow[r] < 0 && !scratch.rowReached[r]) {
+      markAlternating(r, scratch);
+    }
+  }
+
+  // rowCuts[i] bit c cuts between cells (i - 1, c) and (i, c), colCuts[j] bit r cuts between cells (r, j - 1) and (r, j)
+  uint64_t rowCuts[CS] = { 0 };
+  uint64_t colCuts[CS] = { 0 };
+  for (int r = 0; r < rowChordCount; r++) {
+    if (!scratch.rowReached[r]) continue;
+    const LayerChord& chord = scratch.rowChords[r];
+    rowCuts[chord.line] |= ((1ull << (chord.end - chord.begin)) - 1) << chord.begin;
+  }
+  for (int c = 0; c < colChordCount; c++) {
+    if (scratch.visited[c]) continue;
+    const LayerChord& chord = scratch.colChords[c];
+    colCuts[chord.line] |= ((1ull << (chord.end - chord.begin)) - 1) << chord.begin;
+  }
+
+  // Resolve the remaining reflex corners with horizontal cuts
+  for (int line = 1; line < CS; line++) {
+    uint64_t extendRight, extendLeft;
+    getReflexCorners(rows[line - 1], rows[line], extendRight, extendLeft);
+    const uint64_t bothSides = rows[line - 1] & rows[line];
+
+    uint64_t corners = extendRight | extendLeft;
+    while (corners) {
+      const int corner = getFirstBit(corners);
+      corners &= corners - 1;
+
+      const bool right = extendRight >> corner & 1;
+      const bool cutAtCorner = right ? (rowCuts[line] >> corner & 1) : (rowCuts[line] >> (corner - 1) & 1);
+      const bool colCutAtCorner = (colCuts[corner] >> (line - 1) & 1) || (colCuts[corner] >> line & 1);
+      if (cutAtCorner || colCutAtCorner) continue;
+
+      int col = right ? corner : corner - 1;
+      while (col >= 0 && col < CS && (bothSides >> col & 1) && !(rowCuts[line] >> col & 1)) {
+        rowCuts[line] |= 1ull << col;
+
+        const int nextCorner = right ? col + 1 : col;
+        if (nextCorner > 0 && nextCorner < CS && ((colCuts[nextCorner] >> (line - 1) & 1) || (colCuts[nextCorner] >> line & 1))) break;
+        col += right ? 1 : -1;
+      }
+    }
+  }
+
+  // Every piece is now a rectangle, collect them top left first
+  uint64_t assigned[CS] = { 0 };
+  for (int row = 0; row < CS; row++) {
+    uint64_t bits = rows[row] & ~assigned[row];
+    while (bits) {
+      const int col = getFirstBit(bits);
+
+      int cols = 1;
+      while (col + cols < CS && (bits >> (col + cols) & 1) && !(colCuts[col + cols] >> row & 1)) cols++;
+      const uint64_t colBits = ((1ull << cols) - 1) << col;
+
+      int rowEnd = row + 1;
+      while (rowEnd < CS && (rows[rowEnd] & ~assigned[rowEnd] & colBits) == colBits && !(rowCuts[rowEnd] & colBits)) {
+        bool split = false;
+        for (int c = col + 1; c < col + cols; c++) {
+          if (colCuts[c] >> rowEnd & 1) {
+            split = true;
+            break;
+          }
+        }
+        if (split) break;
+        rowEnd++;
+      }
+
+      for (int r = row; r < rowEnd; r++) {
+        assigned[r] |= colBits;
+      }
+      bits &= ~colBits;
+      rects.push_back({ row, col, rowEnd - row, cols });
+    }
+  }
+}
+
+static inline uint64_t getLayerQuad(int face, int layer, const LayerRect& rect, uint8_t type) {
+  const int meshUp = layer + (~face & 1);
+
+  switch (face) {
+  case 0:
+  case 1:
+    return getQuad<false>(rect.row + (face == 1 ? rect.rows : 0), meshUp, rect.col, rect.rows, rect.cols, type);
+  case 2:
+  case 3:
+    return getQuad<false>(meshUp, rect.row + (face == 2 ? rect.rows : 0), rect.col, rect.rows, rect.cols, type);
+  default:
+    return getQuad<false>(rect.col + (face == 4 ? rect.cols : 0), rect.row, meshUp, rect.cols, rect.rows, type);
+  }
+}
+
+void meshHighQuality(const uint8_t* voxels, MeshData& meshData) {
+  // The exact cover is built from the face masks, so this always takes the 3D path
+  BM_STATS_ONLY(meshData.stats = MeshStats(); const uint64_t cullBegin = BM_CYCLES();)
+  cullFaces<uint64_t, CS>(meshData.opaqueMask, meshData.faceMasks, CS);
+  BM_STATS_ONLY(meshData.stats.cullCycles = BM_CYCLES() - cullBegin;)
+  mergeFaces<uint64_t, CS>(voxels, meshData, CS);
+  BM_STATS_ONLY(const int maxVerticesBefore = meshData.maxVertices;)
+
+  const uint64_t* faceMasks = meshData.faceMasks;
+  BM_VECTOR<uint64_t> greedyQuads;
+  greedyQuads.resize(meshData.vertexCount - 1);
+  for (int i = 0; i < meshData.vertexCount - 1; i++) {
+    greedyQuads[i] = (*meshData.vertices)[i];
+  }
+
+  BM_VECTOR<uint64_t> faceQuads;
+  BM_VECTOR<LayerRect> rects;
+  RectCoverScratch scratch;
+  uint8_t types[CS_2];
+  uint64_t layerRows[CS];
+  uint64_t typeRows[CS];
+
+  int vertexI = 0;
+
+  for (int face = 0; face < 6; face++) {
+    const int axis = face / 2;
+    faceQuads.clear();
+
+    for (int layer = 0; layer < CS; layer++) {
+      uint64_t seenTypes[4] = { 0 };
+
+      // Gather the visible faces of the layer as rows of bits plus their types
+      for (int row = 0; row < CS; row++) {
+        uint64_t bits = 0;
+        if (face < 4) {
+          bits = faceMasks[(face * CS_2) + (layer * CS) + row];
+        }
+        else {
+          for (int col = 0; col < CS; col++) {
+            bits |= (faceMasks[(face * CS_2) + (row * CS) + col] >> (layer + 1) & 1) << col;
+          }
+        }
+        layerRows[row] = bits;
+
+        while (bits) {
+          const int col = getFirstBit(bits);
+          bits &= bits - 1;
+
+          const uint8_t type = face < 4
+            ? voxels[getAxisIndex(axis, row + 1, col + 1, layer + 1)]
+            : voxels[getAxisIndex(axis, col + 1, row + 1, layer + 1)];
+          types[(row * CS) + col] = type;
+          seenTypes[type >> 6] |= 1ull << (type & 63);
+        }
+      }
+
+      // Faces of different types can't be merged, so every type is covered separately
+      for (int typeWord = 0; typeWord < 4; typeWord++) {
+        while (seenTypes[typeWord]) {
+          const uint8_t type = (typeWord << 6) | getFirstBit(seenTypes[typeWord]);
+          seenTypes[typeWord] &= seenTypes[typeWord] - 1;
+
+          for (int row = 0; row < CS; row++) {
+            uint64_t bits = layerRows[row];
+            uint64_t typeBits = 0;
+            while (bits) {
+              const int col = getFirstBit(bits);
+              bits &= bits - 1;
+              if (types[(row * CS) + col] == type) {
+                typeBits |= 1ull << col;
+              }
+            }
+            typeRows[row] = typeBits;
+          }
+
+          rects.clear();
+          coverExact(typeRows, rects, scratch);
+
+          for (int i = 0; i < (int) rects.size(); i++) {
+            faceQuads.push_back(getLayerQuad(face, layer, rects[i], type));
+          }
+        }
+      }
+    }
+
+    const int faceVertexBegin = vertexI;
+
+    if ((int) faceQuads.size() < meshData.faceVertexLength[face]) {
+      for (int i = 0; i < (int) faceQuads.size(); i++) {
+        insertQuad(*meshData.vertices, faceQuads[i], vertexI, meshData.maxVertices);
+      }
+    }
+    else {
+      for (int i = 0; i < meshData.faceVertexLength[face]; i++) {
+        insertQuad(*meshData.vertices, greedyQuads[meshData.faceVertexBegin[face] + i], vertexI, meshData.maxVertices);
+      }
+    }
+
+    meshData.faceVertexBegin[face] = faceVertexBegin;
+    meshData.faceVertexLength[face] = vertexI - faceVertexBegin;
   }
 
   meshData.vertexCount = vertexI + 1;
+
+  // The merge statistics are those of the greedy pass, the quad counts those of the output
+  BM_STATS_ONLY(finishStats(meshData, maxVerticesBefore);)
+}
+
+// Adds an edit of the diff, edits are found back to front and merged with the span after them when they touch
+static inline void addQuadEdit(BM_VECTOR<QuadSpan>& spans, const int previousBegin, const int previousLength, const int begin, const int length) {
+  if (spans.size()) {
+    QuadSpan& next = spans.back();
+    if (next.previousBegin == previousBegin + previousLength && next.begin == begin + length) {
+      next.previousBegin = previousBegin;
+      next.previousLength += previousLength;
+      next.begin = begin;
+      next.length += length;
+      return;
+    }
+  }
+
+  QuadSpan span;
+  span.previousBegin = previousBegin;
+  span.previousLength = previousLength;
+  span.begin = begin;
+  span.length = length;
+  spans.push_back(span);
+}
+
+void diffQuads(const uint64_t* previousQuads, int previousLength, const uint64_t* quads, int length, BM_VECTOR<QuadSpan>& spans) {
+  spans.clear();
+
+  // Most remeshes only touch a few layers, so the equal head and tail are skipped first
+  int head = 0;
+  while (head < previousLength && head < length && previousQuads[head] == quads[head]) head++;
+
+  int tail = 0;
+  while (tail < previousLength - head && tail < length - head && previousQuads[previousLength - 1 - tail] == quads[length - 1 - tail]) tail++;
+
+  const uint64_t* a = previousQuads + head;
+  const uint64_t* b = quads + head;
+  const int n = previousLength - head - tail;
+  const int m = length - head - tail;
+
+  if (n == 0 && m == 0) return;
+
+  if (n == 0 || m == 0) {
+    addQuadEdit(spans, head, n, head, m);
+    return;
+  }
+
+  // Myers' diff: furthest[k] is the furthest position in a on diagonal k = x - y after d edits.
+  // The rows of every d are kept in trace to walk the edit script back.
+  const int maxEdits = n + m < QUAD_DIFF_MAX_EDITS ? n + m : QUAD_DIFF_MAX_EDITS;
+  const int offset = maxEdits + 1;
+  BM_VECTOR<int> furthest;
+  furthest.resize(2 * offset + 1, 0);
+  BM_VECTOR<int> trace;
+
+  int edits = -1;
+  for (int d = 0; d <= maxEdits && edits < 0; d++) {
+    for (int k = -d; k <= d; k += 2) {
+      int x = (k == -d || (k != d && furthest[offset + k - 1] < furthest[offset + k + 1])) ? furthest[offset + k + 1] : furthest[offset + k - 1] + 1;
+      int y = x - k;
+      while (x < n && y < m && a[x] == b[y]) {
+        x++;
+        y++;
+      }
+      furthest[offset + k] = x;
+
+      if (x >= n && y >= m) {
+        edits = d;
+        break;
+      }
+    }
+
+    for (int k = -d; k <= d; k++) {
+      trace.push_back(furthest[offset + k]);
+    }
+  }
+
+  // Too many changes for an edit script, everything between the head and the tail is replaced
+  if (edits < 0) {
+    addQuadEdit(spans, head, n, head, m);
+    return;
+  }
+
+  int x = n;
+  int y = m;
+  for (int d = edits; d > 0; d--) {
+    // Row d - 1 of the trace starts after the rows 0 to d - 2, which hold (d - 1)^2 entries
+    const int* previous = &trace[(d - 1) * (d - 1)];
+    auto previousFurthest = [&](const int k) { return previous[k + (d - 1)]; };
+
+    const int k = x - y;
+    const bool inserted = k == -d || (k != d && previousFurthest(k - 1) < previousFurthest(k + 1));
+    const int previousK = inserted ? k + 1 : k - 1;
+    const int previousX = previousFurthest(previousK);
+    const int previousY = previousX - previousK;
+
+    if (inserted) {
+      addQuadEdit(spans, head + previousX, 0, head + previousY, 1);
+    }
+    else {
+      addQuadEdit(spans, head + previousX, 1, head + previousY, 0);
+    }
+
+    x = previousX;
+    y = previousY;
+  }
+
+  for (int i = 0, j = (int) spans.size() - 1; i < j; i++, j--) {
+    const QuadSpan span = spans[i];
+    spans[i] = spans[j];
+    spans[j] = span;
+  }
+}
+
+static constexpr size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+// Rounds a buffer up to the 64 byte alignment that every buffer in a MeshContext arena starts on
+static inline size_t getArenaBufferSize(const size_t size) {
+  return (size + 63) & ~(size_t) 63;
+}
+
+MeshContext::MeshContext(bool hugePages, int maxVertices) {
+  const size_t opaqueMaskSize = getArenaBufferSize(CS_P2 * sizeof(uint64_t));
+  const size_t faceMasksSize = getArenaBufferSize(CS_2 * 6 * sizeof(uint64_t));
+  const size_t forwardMergedSize = getArenaBufferSize(CS_2);
+  const size_t rightMergedSize = getArenaBufferSize(CS);
+  const size_t voxelsSize = getArenaBufferSize(CS_P3);
+
+  const size_t alignment = hugePages ? HUGE_PAGE_SIZE : 64;
+  size_t size = opaqueMaskSize + faceMasksSize + forwardMergedSize + rightMergedSize + voxelsSize;
+  size = (size + alignment - 1) / alignment * alignment;
+
+#if defined(_WIN32)
+  arena = _aligned_malloc(size, alignment);
+#else
+  if (posix_memalign(&arena, alignment, size)) arena = nullptr;
+#endif
+  if (!arena) throw std::bad_alloc();
+
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+  if (hugePages) madvise(arena, size, MADV_HUGEPAGE);
+#endif
+
+  // The merge buffers have to start out zeroed, the mesher resets them after use
+  BM_MEMSET(arena, 0, size);
+
+  uint8_t* buffer = (uint8_t*) arena;
+  meshData.opaqueMask = (uint64_t*) buffer;
+  buffer += opaqueMaskSize;
+  meshData.faceMasks = (uint64_t*) buffer;
+  buffer += faceMasksSize;
+  meshData.forwardMerged = buffer;
+  buffer += forwardMergedSize;
+  meshData.rightMerged = buffer;
+  buffer += rightMergedSize;
+  voxels = buffer;
+
+  vertices.resize(maxVertices);
+  meshData.vertices = &vertices;
+  meshData.maxVertices = maxVertices;
+}
+
+MeshContext::~MeshContext() {
+#if defined(_WIN32)
+  _aligned_free(arena);
+#else
+  free(arena);
+#endif
+}
+
+MeshContextPool::~MeshContextPool() {
+  for (int i = 0; i < (int) contexts.size(); i++) {
+    delete contexts[i];
+  }
+}
+
+MeshContext* MeshContextPool::acquire() {
+  if (freeContexts.size()) {
+    MeshContext* context = freeContexts.back();
+    freeContexts.pop_back();
+    return context;
+  }
+
+  MeshContext* context = new MeshContext(hugePages);
+  contexts.push_back(context);
+  return context;
+}
+
+void MeshContextPool::release(MeshContext* context) {
+  freeContexts.push_back(context);
 }
 
+#endif // MESHER_IMPLEMENTATION_H
 #endif // BM_IMPLEMENTATION
@@ -5,6 +5,7 @@
 #include <glm/glm.hpp>
 #include "../libraries/FastNoise/FastNoise.h"
 #include "utility.h"
+#include "../world/automata.h"
 
 class Noise {
 public:
@@ -32,8 +33,6 @@ public:
             int i = get_zxy_index(x, y, z);
             int i_above = get_zxy_index(x, y + 1, z);
 
-            opaqueMask[(y * CS_P) + x] |= 1ull << z;
-
             switch (voxels[i_above]) {
             case 0:
               voxels[i] = 3;
@@ -46,6 +45,8 @@ public:
         }
       }
     }
+
+    buildOpaqueMask(voxels, nullptr, opaqueMask);
   }
 
   void generateTerrainV2(uint8_t* voxels, uint64_t* opaqueMask, int offsetX, int offsetZ, int seed) {
@@ -61,8 +62,6 @@ public:
           if (val > (float) y / (float) CS_P) {
             int i_above = get_zxy_index(x, y + 1, z);
 
-            opaqueMask[(y * CS_P) + x] |= 1ull << z;
-
             switch (voxels[i_above]) {
             case 0:
               voxels[i] = 3;
@@ -73,12 +72,13 @@ public:
             }
           }
           else if (y < 25) {
-            opaqueMask[(y * CS_P) + x] |= 1ull << z;
             voxels[i] = 1;
           }
         }
       }
     }
+
+    buildOpaqueMask(voxels, nullptr, opaqueMask);
   }
 
   void generateWhiteNoiseTerrain(uint8_t* voxels, uint64_t* opaqueMask, int seed) {
@@ -90,8 +90,6 @@ public:
           float noise = (whiteNoise.GetWhiteNoise(x, y, z));
           int i = get_zxy_index(x, y, z);
 
-          if (noise > 0.5f) opaqueMask[(y * CS_P) + x] |= 1ull << z;
-
           if (noise > 0.8f) {
             voxels[i] = 1;
           } else if (noise > 0.6f) {
@@ -102,6 +100,21 @@ public:
         }
       }
     }
+
+    buildOpaqueMask(voxels, nullptr, opaqueMask);
+  }
+
+  // Random voxels smoothed into caves with a cellular automaton, 64 voxels per operation
+  void generateCaves(uint8_t* voxels, uint64_t* opaqueMask, int seed) {
+    memset(opaqueMask, 0, CS_P2 * sizeof(uint64_t));
+    fillRandom(opaqueMask, 0.5f, seed);
+
+    AutomatonRule rule = getThresholdRule(13);
+    for (int i = 0; i < 5; i++) {
+      stepAutomaton(opaqueMask, opaqueMask, rule);
+    }
+
+    applyMaskToVoxels(opaqueMask, voxels, 1);
   }
 
   FastNoise noise1;
@@ -0,0 +1,85 @@
+#ifndef COLLIDERS_H
+#define COLLIDERS_H
+
+//   Decomposes the occupancy mask of a chunk (MeshData::opaqueMask) into a few large solid boxes for physics
+//   engines.
+
+#include "../mesher.h"
+
+// Solid box in chunk space, voxel (0, 0, 0) is the first voxel after the padding. max is exclusive.
+struct ColliderBox {
+  uint8_t min[3];
+  uint8_t max[3];
+};
+
+// Greedily covers the inner voxels of a chunk with boxes that don't overlap. Every box starts as a run of
+// bits in a column (z), is extended over the next columns in x that contain the whole run, and then over
+// the next layers in y that contain all of those runs. The covered bits are cleared before the next box.
+//
+// @param[out] boxes: Cleared and filled with the boxes.
+void buildColliderBoxes(const uint64_t* opaqueMask, BM_VECTOR<ColliderBox>& boxes);
+
+#endif // COLLIDERS_H
+
+#ifdef BM_IMPLEMENTATION
+#ifndef COLLIDERS_IMPLEMENTATION_H
+#define COLLIDERS_IMPLEMENTATION_H
+
+void buildColliderBoxes(const uint64_t* opaqueMask, BM_VECTOR<ColliderBox>& boxes) {
+  boxes.clear();
+
+  // Bits that are not part of a box yet, indexed like opaqueMask
+  uint64_t remaining[CS_P2];
+  for (int i = 0; i < CS_P2; i++) {
+    remaining[i] = opaqueMask[i] & P_MASK;
+  }
+
+  for (int y = 1; y < CS_P - 1; y++) {
+    for (int x = 1; x < CS_P - 1; x++) {
+      uint64_t& column = remaining[y * CS_P + x];
+
+      while (column) {
+        // Run of bits in z
+        const int zBegin = getFirstBit(column);
+        const int length = getFirstBit(~(column >> zBegin));
+        const uint64_t run = ((1ull << length) - 1) << zBegin;
+
+        // Columns in x that contain the whole run
+        int xEnd = x + 1;
+        while (xEnd < CS_P - 1 && (remaining[y * CS_P + xEnd] & run) == run) {
+          xEnd++;
+        }
+
+        // Layers in y where all of those columns contain the run
+        int yEnd = y + 1;
+        while (yEnd < CS_P - 1) {
+          const uint64_t* row = remaining + yEnd * CS_P;
+          uint64_t covered = run;
+          for (int i = x; i < xEnd; i++) {
+            covered &= row[i];
+          }
+          if (covered != run) break;
+          yEnd++;
+        }
+
+        for (int i = y; i < yEnd; i++) {
+          for (int j = x; j < xEnd; j++) {
+            remaining[i * CS_P + j] &= ~run;
+          }
+        }
+
+        ColliderBox box;
+        box.min[0] = x - 1;
+        box.min[1] = y - 1;
+        box.min[2] = zBegin - 1;
+        box.max[0] = xEnd - 1;
+        box.max[1] = yEnd - 1;
+        box.max[2] = zBegin + length - 1;
+        boxes.push_back(box);
+      }
+    }
+  }
+}
+
+#endif // COLLIDERS_IMPLEMENTATION_H
+#endif // BM_IMPLEMENTATION
@@ -0,0 +1,216 @@
+#ifndef COLLISION_H
+#define COLLISION_H
+
+//   Swept AABB collision queries against the occupancy masks of the mesher (MeshData::opaqueMask).
+//
+//   Coordinates are the same as in raycast.h: chunk space voxel (0, 0, 0) is the first voxel after the
+//   padding, and world space is chunkPos * CS + chunk space.
+
+#include "../mesher.h"
+#include <math.h> // floorf, ceilf
+
+struct SweptBox {
+  float min[3] = { 0 };
+  float max[3] = { 0 };
+  float velocity[3] = { 0 }; // Movement over the whole sweep, from time 0 to 1
+};
+
+struct SweptContact {
+  float time = 1; // Earliest time in [0, 1] at which the box touches a voxel, 1 without contact
+  int normal[3] = { 0 }; // Normal of the voxel face that was touched
+  bool hit = false;
+};
+
+// Finds the earliest time at which a moving box runs into a voxel. The box is tested whenever its leading
+// face crosses a voxel boundary, against the columns it covers at that time with 64-bit range masks. Boxes
+// only touching a voxel, like a box sliding along a wall, don't collide. Boxes that already overlap voxels
+// at time 0 are only stopped by voxels they move into.
+//
+// @param[in] opaqueMask: Occupancy mask of the chunk. Only the voxels inside the chunk collide, not the padding.
+// @return Whether the box hits a voxel before the end of the sweep.
+bool sweepChunk(const uint64_t* opaqueMask, const SweptBox& box, SweptContact& contact);
+
+// Sweeps a batch of boxes against the same chunk
+void sweepChunk(const uint64_t* opaqueMask, const SweptBox* boxes, SweptContact* contacts, int count);
+
+// @param[in] getOpaqueMask: Called as getOpaqueMask(chunkX, chunkY, chunkZ) for the chunks that boxes touch.
+// Returns the occupancy mask of the chunk, or nullptr for chunks that are empty or not loaded.
+// @return Whether the box hits a voxel before the end of the sweep.
+template <typename GetOpaqueMask>
+bool sweepWorld(GetOpaqueMask getOpaqueMask, const SweptBox& box, SweptContact& contact);
+
+// Sweeps a batch of boxes through the world. Consecutive boxes in the same chunks share their chunk
+// lookups, so batches sorted by position are cheaper.
+template <typename GetOpaqueMask>
+void sweepWorld(GetOpaqueMask getOpaqueMask, const SweptBox* boxes, SweptContact* contacts, int count);
+
+// Whether any voxel in the inclusive box [min, max] of padded chunk coordinates is set in opaqueMask.
+// Tests a z range of every column at once.
+bool isRegionSolid(const uint64_t* opaqueMask, const int* min, const int* max);
+
+// Sweeps a box through voxels, isSolid(min, max) tests an inclusive box of voxels
+template <typename IsSolid>
+bool sweepBox(IsSolid& isSolid, const SweptBox& box, SweptContact& contact);
+
+// Looks up the chunks of world space regions for sweepWorld(), remembering the last chunk
+template <typename GetOpaqueMask>
+struct WorldRegion {
+  GetOpaqueMask& getOpaqueMask;
+  int chunk[3] = { 0 };
+  const uint64_t* opaqueMask = nullptr;
+  bool cached = false;
+
+  WorldRegion(GetOpaqueMask& getOpaqueMask) : getOpaqueMask(getOpaqueMask) {}
+
+  const uint64_t* getChunk(const int x, const int y, const int z) {
+    if (!cached || chunk[0] != x || chunk[1] != y || chunk[2] != z) {
+      chunk[0] = x;
+      chunk[1] = y;
+      chunk[2] = z;
+      opaqueMask = getOpaqueMask(x, y, z);
+      cached = true;
+    }
+    return opaqueMask;
+  }
+
+  bool operator()(const int* min, const int* max) {
+    int chunkMin[3];
+    int chunkMax[3];
+    for (int axis = 0; axis < 3; axis++) {
+      chunkMin[axis] = getChunkCoordinate(min[axis]);
+      chunkMax[axis] = getChunkCoordinate(max[axis]);
+    }
+
+    for (int y = chunkMin[1]; y <= chunkMax[1]; y++) {
+      for (int x = chunkMin[0]; x <= chunkMax[0]; x++) {
+        for (int z = chunkMin[2]; z <= chunkMax[2]; z++) {
+          const uint64_t* mask = getChunk(x, y, z);
+          if (!mask) continue;
+
+          const int origin[3] = { x * CS, y * CS, z * CS };
+          int localMin[3];
+          int localMax[3];
+          for (int axis = 0; axis < 3; axis++) {
+            localMin[axis] = (min[axis] > origin[axis] ? min[axis] : origin[axis]) - origin[axis] + 1;
+            localMax[axis] = (max[axis] < origin[axis] + CS - 1 ? max[axis] : origin[axis] + CS - 1) - origin[axis] + 1;
+          }
+          if (isRegionSolid(mask, localMin, localMax)) return true;
+        }
+      }
+    }
+    return false;
+  }
+
+  static int getChunkCoordinate(const int voxel) {
+    return voxel >= 0 ? voxel / CS : (voxel + 1) / CS - 1;
+  }
+};
+
+template <typename IsSolid>
+bool sweepBox(IsSolid& isSolid, const SweptBox& box, SweptContact& contact) {
+  contact = SweptContact();
+
+  for (int axis = 0; axis < 3; axis++) {
+    const float velocity = box.velocity[axis];
+    if (velocity == 0) continue;
+
+    // Walk the voxel boundaries that the leading face of the box crosses
+    const int step = velocity > 0 ? 1 : -1;
+    const float leadingFace = velocity > 0 ? box.max[axis] : box.min[axis];
+    int boundary = (int) (velocity > 0 ? ceilf(leadingFace) : floorf(leadingFace));
+
+    while (true) {
+      const float time = (boundary - leadingFace) / velocity;
+      if (time > contact.time || (contact.hit && time == contact.time)) break;
+
+      // The voxels beyond the boundary that the box covers at that time
+      int min[3];
+      int max[3];
+      min[axis] = max[axis] = velocity > 0 ? boundary : boundary - 1;
+
+      // Voxels that the box only touches count if the box is moving into them
+      bool empty = false;
+      for (int other = 1; other < 3; other++) {
+        const int otherAxis = (axis + other) % 3;
+        const float otherVelocity = box.velocity[otherAxis];
+        const float low = box.min[otherAxis] + otherVelocity * time;
+        const float high = box.max[otherAxis] + otherVelocity * time;
+        min[otherAxis] = (int) (otherVelocity < 0 ? ceilf(low) - 1 : floorf(low));
+        max[otherAxis] = (int) (otherVelocity > 0 ? floorf(high) : ceilf(high) - 1);
+        empty |= min[otherAxis] > max[otherAxis];
+      }
+
+      if (!empty && isSolid(min, max)) {
+        contact.time = time;
+        contact.normal[0] = contact.normal[1] = contact.normal[2] = 0;
+        contact.normal[axis] = -step;
+        contact.hit = true;
+        break;
+      }
+      boundary += step;
+    }
+  }
+
+  return contact.hit;
+}
+
+template <typename GetOpaqueMask>
+bool sweepWorld(GetOpaqueMask getOpaqueMask, const SweptBox& box, SweptContact& contact) {
+  WorldRegion<GetOpaqueMask> region(getOpaqueMask);
+  return sweepBox(region, box, contact);
+}
+
+template <typename GetOpaqueMask>
+void sweepWorld(GetOpaqueMask getOpaqueMask, const SweptBox* boxes, SweptContact* contacts, int count) {
+  WorldRegion<GetOpaqueMask> region(getOpaqueMask);
+  for (int i = 0; i < count; i++) {
+    sweepBox(region, boxes[i], contacts[i]);
+  }
+}
+
+#endif // COLLISION_H
+
+#ifdef BM_IMPLEMENTATION
+#ifndef COLLISION_IMPLEMENTATION_H
+#define COLLISION_IMPLEMENTATION_H
+
+bool isRegionSolid(const uint64_t* opaqueMask, const int* min, const int* max) {
+  const uint64_t range = (~0ull >> (63 - max[2])) & (~0ull << min[2]);
+  for (int y = min[1]; y <= max[1]; y++) {
+    for (int x = min[0]; x <= max[0]; x++) {
+      if (opaqueMask[y * CS_P + x] & range) return true;
+    }
+  }
+  return false;
+}
+
+// Clips voxel regions to the inside of one chunk for sweepChunk()
+struct ChunkRegion {
+  const uint64_t* opaqueMask;
+
+  bool operator()(const int* min, const int* max) {
+    int localMin[3];
+    int localMax[3];
+    for (int axis = 0; axis < 3; axis++) {
+      localMin[axis] = (min[axis] < 0 ? 0 : min[axis]) + 1;
+      localMax[axis] = (max[axis] > CS - 1 ? CS - 1 : max[axis]) + 1;
+      if (localMin[axis] > localMax[axis]) return false;
+    }
+    return isRegionSolid(opaqueMask, localMin, localMax);
+  }
+};
+
+bool sweepChunk(const uint64_t* opaqueMask, const SweptBox& box, SweptContact& contact) {
+  ChunkRegion region = { opaqueMask };
+  return sweepBox(region, box, contact);
+}
+
+void sweepChunk(const uint64_t* opaqueMask, const SweptBox* boxes, SweptContact* contacts, int count) {
+  ChunkRegion region = { opaqueMask };
+  for (int i = 0; i < count; i++) {
+    sweepBox(region, boxes[i], contacts[i]);
+  }
+}
+
+#endif // COLLISION_IMPLEMENTATION_H
+#endif // BM_IMPLEMENTATION
@@ -0,0 +1,352 @@
+#ifndef RAYCAST_H
+#define RAYCAST_H
+
+//   Voxel raycasts against the occupancy masks of the mesher (MeshData::opaqueMask).
+//
+//   Chunk space coordinates are the coordinates of the quads of a chunk: voxel (0, 0, 0) is the
+//   first voxel after the padding. World space coordinates are chunkPos * CS + chunk space.
+
+#include "../mesher.h"
+#include <algorithm> // std::sort
+
+struct Ray {
+  float origin[3] = { 0 };
+  float direction[3] = { 0 }; // Doesn't have to be normalized
+  float maxDistance = 0;
+};
+
+struct RayHit {
+  int voxel[3] = { 0 };
+  int face = -1; // Face of the hit voxel that the ray entered through, in mesher order. -1 if the ray started inside it.
+  float distance = 0; // Distance from the ray origin to the hit
+  bool hit = false;
+};
+
+// @param[in] opaqueMask: Occupancy mask of the chunk. Only the voxels inside the chunk are hit, not the padding.
+// @return Whether the ray hit a voxel within ray.maxDistance.
+bool raycastChunk(const uint64_t* opaqueMask, const Ray& ray, RayHit& hit);
+
+// Traces a batch of rays against the same chunk, for example for block picking or line of sight checks
+// of many entities. The mask stays in cache for the whole batch.
+void raycastChunk(const uint64_t* opaqueMask, const Ray* rays, RayHit* hits, int count);
+
+// @param[in] getOpaqueMask: Called as getOpaqueMask(chunkX, chunkY, chunkZ) for every chunk along the ray.
+// Returns the occupancy mask of the chunk, or nullptr for chunks that are empty or not loaded.
+// @return Whether the ray hit a voxel within ray.maxDistance.
+template <typename GetOpaqueMask>
+bool raycastWorld(GetOpaqueMask getOpaqueMask, const Ray& ray, RayHit& hit);
+
+// Traces a batch of rays through the world. The rays are advanced chunk by chunk and grouped by the
+// chunk they are in, so that every chunk is looked up once per step and all rays in it are traced
+// while its mask is in cache.
+template <typename GetOpaqueMask>
+void raycastWorld(GetOpaqueMask getOpaqueMask, const Ray* rays, RayHit* hits, int count);
+
+// Walks the chunks that a ray passes through in order
+struct RayChunkWalk {
+  int chunk[3];
+  int step[3];
+  float tMax[3];
+  float tDelta[3];
+  float t; // Where the ray enters the current chunk
+
+  // Starts at the chunk that the ray is in at distance start
+  void init(const float* origin, const float* direction, float start = 0);
+  void next();
+};
+
+// Normalizes the direction of a ray, returns false for a zero direction
+bool getRayDirection(const Ray& ray, float* direction);
+
+// Traces a ray with a normalized direction through the voxels of opaqueMask in the box [boxMin, boxMax).
+// The origin and box are in the padded coordinates of opaqueMask and the hit voxel is returned in them as well.
+bool traceBox(const uint64_t* opaqueMask, const float* origin, const float* direction, float maxDistance, const int* boxMin, const int* boxMax, RayHit& hit);
+
+// traceBox() through the inner voxels of a chunk
+bool traceChunk(const uint64_t* opaqueMask, const float* origin, const float* direction, float maxDistance, RayHit& hit);
+
+template <typename GetOpaqueMask>
+bool raycastWorld(GetOpaqueMask getOpaqueMask, const Ray& ray, RayHit& hit) {
+  hit = RayHit();
+
+  float direction[3];
+  if (!getRayDirection(ray, direction)) return false;
+
+  RayChunkWalk walk;
+  walk.init(ray.origin, direction);
+
+  while (walk.t <= ray.maxDistance) {
+    const uint64_t* opaqueMask = getOpaqueMask(walk.chunk[0], walk.chunk[1], walk.chunk[2]);
+    if (opaqueMask) {
+      float origin[3];
+      for (int axis = 0; axis < 3; axis++) {
+        origin[axis] = ray.origin[axis] - walk.chunk[axis] * CS + 1;
+      }
+
+      if (traceChunk(opaqueMask, origin, direction, ray.maxDistance, hit)) {
+        for (int axis = 0; axis < 3; axis++) {
+          hit.voxel[axis] += walk.chunk[axis] * CS - 1;
+        }
+        return true;
+      }
+    }
+    walk.next();
+  }
+
+  return false;
+}
+
+template <typename GetOpaqueMask>
+void raycastWorld(GetOpaqueMask getOpaqueMask, const Ray* rays, RayHit* hits, int count) {
+  BM_VECTOR<RayChunkWalk> walks(count);
+  BM_VECTOR<float> directions(count * 3);
+  BM_VECTOR<int> active;
+  active.reserve(count);
+
+  for (int i = 0; i < count; i++) {
+    hits[i] = RayHit();
+    if (getRayDirection(rays[i], &directions[i * 3])) {
+      walks[i].init(rays[i].origin, &directions[i * 3]);
+      if (walks[i].t <= rays[i].maxDistance) active.push_back(i);
+    }
+  }
+
+  while (active.size()) {
+    std::sort(active.begin(), active.end(), [&](const int a, const int b) {
+      const int* chunkA = walks[a].chunk;
+      const int* chunkB = walks[b].chunk;
+      if (chunkA[1] != chunkB[1]) return chunkA[1] < chunkB[1];
+      if (chunkA[0] != chunkB[0]) return chunkA[0] < chunkB[0];
+      return chunkA[2] < chunkB[2];
+    });
+
+    int activeCount = 0;
+    int chunk[3] = { 0 };
+    const uint64_t* opaqueMask = nullptr;
+    for (int i = 0; i < (int) active.size(); i++) {
+      const int rayI = active[i];
+      RayChunkWalk& walk = walks[rayI];
+      const Ray& ray = rays[rayI];
+
+      // Look up every chunk once for all rays in it
+      if (!i || chunk[0] != walk.chunk[0] || chunk[1] != walk.chunk[1] || chunk[2] != walk.chunk[2]) {
+        for (int axis = 0; axis < 3; axis++) {
+          chunk[axis] = walk.chunk[axis];
+        }
+        opaqueMask = getOpaqueMask(chunk[0], chunk[1], chunk[2]);
+      }
+
+      if (opaqueMask) {
+        float origin[3];
+        for (int axis = 0; axis < 3; axis++) {
+          origin[axis] = ray.origin[axis] - walk.chunk[axis] * CS + 1;
+        }
+
+        RayHit& hit = hits[rayI];
+        if (traceChunk(opaqueMask, origin, &directions[rayI * 3], ray.maxDistance, hit)) {
+          for (int axis = 0; axis < 3; axis++) {
+            hit.voxel[axis] += walk.chunk[axis] * CS - 1;
+          }
+          continue;
+        }
+      }
+
+      walk.next();
+      if (walk.t <= ray.maxDistance) active[activeCount++] = rayI;
+    }
+    active.resize(activeCount);
+  }
+}
+
+#endif // RAYCAST_H
+
+#ifdef BM_IMPLEMENTATION
+#ifndef RAYCAST_IMPLEMENTATION_H
+#define RAYCAST_IMPLEMENTATION_H
+
+#include <math.h> // floorf, sqrtf
+#include <float.h> // FLT_MAX
+
+// Face of a voxel that a ray moving along axis enters through
+static inline int getRayEntryFace(const int axis, const int step) {
+  static constexpr int positiveFaces[3] = { 2, 0, 4 };
+  return positiveFaces[axis] + (step > 0);
+}
+
+bool getRayDirection(const Ray& ray, float* direction) {
+  const float* d = ray.direction;
+  const float length = sqrtf(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+  if (length == 0) return false;
+
+  for (int axis = 0; axis < 3; axis++) {
+    direction[axis] = d[axis] / length;
+  }
+  return true;
+}
+
+void RayChunkWalk::init(const float* origin, const float* direction, float start) {
+  t = start;
+  for (int axis = 0; axis < 3; axis++) {
+    chunk[axis] = (int) floorf((origin[axis] + direction[axis] * start) / CS);
+    if (direction[axis] > 0) {
+      step[axis] = 1;
+      tDelta[axis] = CS / direction[axis];
+      tMax[axis] = ((chunk[axis] + 1) * CS - origin[axis]) / direction[axis];
+    }
+    else if (direction[axis] < 0) {
+      step[axis] = -1;
+      tDelta[axis] = -CS / direction[axis];
+      tMax[axis] = (chunk[axis] * CS - origin[axis]) / direction[axis];
+    }
+    else {
+      step[axis] = 0;
+      tDelta[axis] = FLT_MAX;
+      tMax[axis] = FLT_MAX;
+    }
+  }
+}
+
+void RayChunkWalk::next() {
+  int axis = tMax[0] < tMax[1] ? 0 : 1;
+  if (tMax[2] < tMax[axis]) axis = 2;
+
+  chunk[axis] += step[axis];
+  t = tMax[axis];
+  tMax[axis] += tDelta[axis];
+}
+
+bool traceBox(const uint64_t* opaqueMask, const float* origin, const float* direction, float maxDistance, const int* boxMin, const int* boxMax, RayHit& hit) {
+  // Clip the ray to the box
+  float tStart = 0;
+  float tEnd = maxDistance;
+  int face = -1;
+  for (int axis = 0; axis < 3; axis++) {
+    if (direction[axis] == 0) {
+      if (origin[axis] < boxMin[axis] || origin[axis] >= boxMax[axis]) return false;
+      continue;
+    }
+
+    const float tMin = (boxMin[axis] - origin[axis]) / direction[axis];
+    const float tMax = (boxMax[axis] - origin[axis]) / direction[axis];
+    const float tNear = direction[axis] > 0 ? tMin : tMax;
+    const float tFar = direction[axis] > 0 ? tMax : tMin;
+    if (tNear > tStart) {
+      tStart = tNear;
+      face = getRayEntryFace(axis, direction[axis] > 0 ? 1 : -1);
+    }
+    if (tFar < tEnd) tEnd = tFar;
+  }
+  if (tStart >= tEnd) return false;
+
+  int voxel[3];
+  int step[3];
+  float tMax[3];
+  float tDelta[3];
+  for (int axis = 0; axis < 3; axis++) {
+    int v = (int) floorf(origin[axis] + direction[axis] * tStart);
+    v = v < boxMin[axis] ? boxMin[axis] : v >= boxMax[axis] ? boxMax[axis] - 1 : v;
+    voxel[axis] = v;
+
+    if (direction[axis] > 0) {
+      step[axis] = 1;
+      tDelta[axis] = 1 / direction[axis];
+      tMax[axis] = (v + 1 - origin[axis]) / direction[axis];
+    }
+    else if (direction[axis] < 0) {
+      step[axis] = -1;
+      tDelta[axis] = -1 / direction[axis];
+      tMax[axis] = (v - origin[axis]) / direction[axis];
+    }
+    else {
+      step[axis] = 0;
+      tDelta[axis] = FLT_MAX;
+      tMax[axis] = FLT_MAX;
+    }
+  }
+
+  int& x = voxel[0];
+  int& y = voxel[1];
+  int& z = voxel[2];
+  float t = tStart;
+
+  // The ray stays in one z column until it crosses an x or y boundary. All voxels it passes in the column
+  // are tested at once, and the first solid one is found with ctz or clz instead of stepping through the air.
+  while (true) {
+    float tColumn = tMax[0] < tMax[1] ? tMax[0] : tMax[1];
+    if (tEnd < tColumn) tColumn = tEnd;
+
+    int zSteps = 0;
+    if (step[2] && tMax[2] < tColumn) {
+      zSteps = (int) ((tColumn - tMax[2]) / tDelta[2]) + 1;
+      const int maxSteps = step[2] > 0 ? boxMax[2] - 1 - z : z - boxMin[2];
+      if (zSteps > maxSteps) zSteps = maxSteps;
+    }
+    const int zEnd = z + zSteps * step[2];
+
+    const int low = z < zEnd ? z : zEnd;
+    const int high = z < zEnd ? zEnd : z;
+    const uint64_t range = (~0ull >> (63 - high)) & (~0ull << low);
+    const uint64_t bits = opaqueMask[y * CS_P + x] & range;
+
+    if (bits) {
+      const int hitZ = step[2] > 0 ? getFirstBit(bits) : getLastBit(bits);
+      hit.voxel[0] = x;
+      hit.voxel[1] = y;
+      hit.voxel[2] = hitZ;
+      if (hitZ == z) {
+        hit.face = face;
+        hit.distance = t;
+      }
+      else {
+        const int passed = hitZ > z ? hitZ - z : z - hitZ;
+        hit.face = getRayEntryFace(2, step[2]);
+        hit.distance = tMax[2] + (passed - 1) * tDelta[2];
+      }
+      hit.hit = true;
+      return true;
+    }
+
+    z = zEnd;
+    tMax[2] += zSteps * tDelta[2];
+
+    if (tColumn >= tEnd) return false;
+
+    const int axis = tMax[0] < tMax[1] ? 0 : 1;
+    voxel[axis] += step[axis];
+    if (voxel[axis] < boxMin[axis] || voxel[axis] >= boxMax[axis]) return false;
+
+    t = tMax[axis];
+    tMax[axis] += tDelta[axis];
+    face = getRayEntryFace(axis, step[axis]);
+  }
+}
+
+bool traceChunk(const uint64_t* opaqueMask, const float* origin, const float* direction, float maxDistance, RayHit& hit) {
+  static constexpr int boxMin[3] = { 1, 1, 1 };
+  static constexpr int boxMax[3] = { CS_P - 1, CS_P - 1, CS_P - 1 };
+  return traceBox(opaqueMask, origin, direction, maxDistance, boxMin, boxMax, hit);
+}
+
+bool raycastChunk(const uint64_t* opaqueMask, const Ray& ray, RayHit& hit) {
+  hit = RayHit();
+
+  float direction[3];
+  if (!getRayDirection(ray, direction)) return false;
+
+  const float origin[3] = { ray.origin[0] + 1, ray.origin[1] + 1, ray.origin[2] + 1 };
+  if (!traceChunk(opaqueMask, origin, direction, ray.maxDistance, hit)) return false;
+
+  for (int axis = 0; axis < 3; axis++) {
+    hit.voxel[axis]--;
+  }
+  return true;
+}
+
+void raycastChunk(const uint64_t* opaqueMask, const Ray* rays, RayHit* hits, int count) {
+  for (int i = 0; i < count; i++) {
+    raycastChunk(opaqueMask, rays[i], hits[i]);
+  }
+}
+
+#endif // RAYCAST_IMPLEMENTATION_H
+#endif // BM_IMPLEMENTATION
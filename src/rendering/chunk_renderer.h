@@ -140,6 +140,60 @@ public:
     glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
   }
 
+  // Uploads only the quads that changed since the command was last buffered, spans come from diffQuads().
+  // Quads between the spans are uploaded as well where inserts or removes before them shifted them.
+  // Returns false if the quads no longer fit into the slot of the command, which then has to be reallocated.
+  bool bufferChanges(DrawElementsIndirectCommand& command, const uint64_t* quads, int quadCount, const std::vector<QuadSpan>& spans) {
+    uint32_t startByte = (command.baseQuad >> 2) * QUAD_SIZE;
+
+    BufferSlot* slot = nullptr;
+    for (auto usedSlot : usedSlots) {
+      if (usedSlot->startByte == startByte) {
+        slot = usedSlot;
+        break;
+      }
+    }
+
+    if (!slot || quadCount * QUAD_SIZE > slot->sizeBytes) {
+      return false;
+    }
+
+    // Ranges of new quads to upload, adjacent ranges are joined into one upload
+    std::vector<std::pair<int, int>> ranges;
+    auto addRange = [&](int begin, int end) {
+      if (begin >= end) return;
+      if (ranges.size() && ranges.back().second == begin) {
+        ranges.back().second = end;
+      }
+      else {
+        ranges.push_back({ begin, end });
+      }
+    };
+
+    int shift = 0;
+    int previousEnd = 0;
+    for (const auto& span : spans) {
+      if (shift) {
+        addRange(previousEnd, span.begin);
+      }
+      addRange(span.begin, span.begin + span.length);
+      shift = (span.begin + span.length) - (span.previousBegin + span.previousLength);
+      previousEnd = span.begin + span.length;
+    }
+    if (shift) {
+      addRange(previousEnd, quadCount);
+    }
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, SSBO);
+    for (const auto& [begin, end] : ranges) {
+      glBufferSubData(GL_SHADER_STORAGE_BUFFER, startByte + begin * QUAD_SIZE, (end - begin) * QUAD_SIZE, quads + begin);
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    command.indexCount = quadCount * 6;
+    return true;
+  }
+
   inline void addDrawCommand(const DrawElementsIndirectCommand& command) {
     drawCommands.insert(drawCommands.end(), command);
   };
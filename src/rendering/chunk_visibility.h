@@ -0,0 +1,95 @@
+#ifndef CHUNK_VISIBILITY
+#define CHUNK_VISIBILITY
+
+#include <vector>
+#include <algorithm>
+#include <glm/glm.hpp>
+#include "../world/visibility.h"
+
+// Cave culling: finds the chunks that the camera can see through air with a breadth first search over the
+// face connectivity of chunks (see getFaceConnectivity()). A chunk is only left through the faces that connect
+// to the face it was entered from, and never back towards the camera.
+class ChunkVisibility {
+public:
+  // @param[in] minChunk, maxChunk: Inclusive chunk bounds of the search. Chunks without voxel data are open.
+  void init(glm::ivec3 minChunk, glm::ivec3 maxChunk) {
+    min = minChunk;
+    size = maxChunk - minChunk + 1;
+    connectivity.assign(size.x * size.y * size.z, FACE_CONNECTIVITY_ALL);
+    visible.assign(size.x * size.y * size.z, 1);
+  }
+
+  void setConnectivity(glm::ivec3 chunkPos, uint16_t faceConnectivity) {
+    int index = getIndex(chunkPos);
+    if (index >= 0) {
+      connectivity[index] = faceConnectivity;
+    }
+  }
+
+  // Everything is visible while the camera is outside of the bounds
+  void update(glm::vec3 cameraPosition) {
+    glm::ivec3 cameraChunk = glm::ivec3(glm::floor(cameraPosition / (float) CS));
+    int start = getIndex(cameraChunk);
+    if (start < 0) {
+      std::fill(visible.begin(), visible.end(), 1);
+      return;
+    }
+
+    static const glm::ivec3 faceDirections[6] = {
+      glm::ivec3(0, 1, 0), glm::ivec3(0, -1, 0),
+      glm::ivec3(1, 0, 0), glm::ivec3(-1, 0, 0),
+      glm::ivec3(0, 0, 1), glm::ivec3(0, 0, -1),
+    };
+
+    std::fill(visible.begin(), visible.end(), 0);
+    visible[start] = 1;
+    queue.clear();
+    queue.push_back({ cameraChunk, -1, 0 });
+
+    for (size_t i = 0; i < queue.size(); i++) {
+      const Step step = queue[i];
+      uint16_t faceConnectivity = connectivity[getIndex(step.chunkPos)];
+
+      for (int face = 0; face < 6; face++) {
+        if (step.directions & (1 << (face ^ 1))) continue;
+        if (step.enteredFace >= 0 && !areFacesConnected(faceConnectivity, step.enteredFace, face)) continue;
+
+        glm::ivec3 neighbourPos = step.chunkPos + faceDirections[face];
+        int neighbour = getIndex(neighbourPos);
+        if (neighbour < 0 || visible[neighbour]) continue;
+
+        visible[neighbour] = 1;
+        queue.push_back({ neighbourPos, face ^ 1, (uint8_t) (step.directions | (1 << face)) });
+      }
+    }
+  }
+
+  // Chunks outside of the bounds are always visible
+  bool isVisible(glm::ivec3 chunkPos) const {
+    int index = getIndex(chunkPos);
+    return index < 0 || visible[index];
+  }
+
+private:
+  struct Step {
+    glm::ivec3 chunkPos;
+    int enteredFace; // Face of the chunk that the search came in through, -1 for the camera's chunk
+    uint8_t directions; // Faces that the search has moved through since the camera's chunk
+  };
+
+  glm::ivec3 min = glm::ivec3(0);
+  glm::ivec3 size = glm::ivec3(0);
+  std::vector<uint16_t> connectivity;
+  std::vector<uint8_t> visible;
+  std::vector<Step> queue;
+
+  int getIndex(glm::ivec3 chunkPos) const {
+    glm::ivec3 p = chunkPos - min;
+    if (p.x < 0 || p.y < 0 || p.z < 0 || p.x >= size.x || p.y >= size.y || p.z >= size.z) {
+      return -1;
+    }
+    return (p.y * size.z + p.z) * size.x + p.x;
+  }
+};
+
+#endif
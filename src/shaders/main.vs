@@ -53,9 +53,11 @@ void main() {
   uint quadData2 = data[ssboIndex].quadData2;
 
   ivec3 iVertexPos = ivec3(quadData1, quadData1 >> 6u, quadData1 >> 12u) & 63;
+  iVertexPos |= ivec3((quadData1 >> 30u)&1u, (quadData2 >> 8u)&63u, quadData1 >> 31u) << 6;
   iVertexPos += chunkOffsetPos;
 
-  int w = int((quadData1 >> 18u)&63u), h = int((quadData1 >> 24u)&63u);
+  // The high bits of x, y, z, w and h are only set by tall and super chunks
+  int w = int((quadData1 >> 18u)&63u | ((quadData2 >> 14u)&63u) << 6), h = int((quadData1 >> 24u)&63u | ((quadData2 >> 20u)&63u) << 6);
   uint wDir = (face & 2) >> 1, hDir = 2 - (face >> 2);
   int wMod = vertexID >> 1, hMod = vertexID & 1;
 
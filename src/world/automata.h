@@ -0,0 +1,290 @@
+#ifndef AUTOMATA_H
+#define AUTOMATA_H
+
+//   Cellular automata and morphology over occupancy masks (MeshData::opaqueMask) for world generation,
+//   such as carving caves from random noise and smoothing terrain.
+//
+//   Neighbour counts are kept in bit-sliced adders, one plane per bit of the count, so every operation
+//   works on the 64 voxels of a column word at once. Only the inner voxels are written, the padding ring
+//   is read as the neighbouring chunks and copied to the result.
+
+#include "../mesher.h"
+
+enum Neighbourhood {
+  NEIGHBOURHOOD_6, // Faces
+  NEIGHBOURHOOD_26, // Faces, edges and corners
+};
+
+struct AutomatonRule {
+  uint32_t birth = 0; // Bit n is set if an air voxel with n solid neighbours (of 26) becomes solid
+  uint32_t survival = 0; // Bit n is set if a solid voxel with n solid neighbours stays solid
+};
+
+// Rule where every voxel with at least threshold solid neighbours becomes or stays solid, and every
+// other voxel becomes air. 13 smooths random noise into caves.
+AutomatonRule getThresholdRule(int threshold);
+
+// Fills the inner voxels of a mask with random bits that are set with the given density (0-1),
+// combining up to 8 random words per column word.
+void fillRandom(uint64_t* mask, float density, uint64_t seed);
+
+// Applies one step of an automaton. mask and result can be the same.
+void stepAutomaton(const uint64_t* mask, uint64_t* result, const AutomatonRule& rule);
+
+// Morphology with a 3x3x3 cube or a 6-neighbour cross. mask and result can be the same.
+void dilateMask(const uint64_t* mask, uint64_t* result, Neighbourhood neighbourhood = NEIGHBOURHOOD_26);
+void erodeMask(const uint64_t* mask, uint64_t* result, Neighbourhood neighbourhood = NEIGHBOURHOOD_26);
+// Erode then dilate, removes thin walls and floating specks
+void openMask(const uint64_t* mask, uint64_t* result, Neighbourhood neighbourhood = NEIGHBOURHOOD_26);
+// Dilate then erode, fills small holes and gaps
+void closeMask(const uint64_t* mask, uint64_t* result, Neighbourhood neighbourhood = NEIGHBOURHOOD_26);
+
+// Writes a mask into the voxels for mesh(): voxels outside of the mask become air, air voxels in the
+// mask get type and solid voxels in the mask keep their type. Pass the mask as MeshData::opaqueMask.
+void applyMaskToVoxels(const uint64_t* mask, uint8_t* voxels, uint8_t type);
+
+#endif // AUTOMATA_H
+
+#ifdef BM_IMPLEMENTATION
+#ifndef AUTOMATA_IMPLEMENTATION_H
+#define AUTOMATA_IMPLEMENTATION_H
+
+#include <string.h> // memcpy
+
+// Planes of the bit-sliced neighbour counts. A column and the 3x3 columns around it hold up to 27 solid voxels.
+static constexpr int COUNT_BITS = 5;
+
+// out = a + b with bits planes each, out gets bits + 1 planes
+static inline void addSliced(const uint64_t* a, const uint64_t* b, const int bits, uint64_t* out) {
+  uint64_t carry = 0;
+  for (int i = 0; i < bits; i++) {
+    const uint64_t sum = a[i] ^ b[i];
+    out[i] = sum ^ carry;
+    carry = (a[i] & b[i]) | (carry & sum);
+  }
+  out[bits] = carry;
+}
+
+// Sum of three bit-sliced numbers with bits planes each, out gets bits + 2 planes
+static inline void addSliced(const uint64_t* a, const uint64_t* b, const uint64_t* c, const int bits, uint64_t* out) {
+  uint64_t ab[COUNT_BITS + 1];
+  uint64_t wide[COUNT_BITS + 1];
+  addSliced(a, b, bits, ab);
+  for (int i = 0; i < bits; i++) {
+    wide[i] = c[i];
+  }
+  wide[bits] = 0;
+  addSliced(ab, wide, bits + 1, out);
+}
+
+// Bits of a bit-sliced count that are in [low, high]
+static inline uint64_t getCountInRange(const uint64_t* count, const int low, const int high) {
+  uint64_t atLeastLow = 0;
+  uint64_t aboveHigh = 0;
+  uint64_t equalLow = ~0ull;
+  uint64_t equalHigh = ~0ull;
+  for (int b = COUNT_BITS - 1; b >= 0; b--) {
+    const uint64_t lowBit = 0 - (uint64_t) ((low >> b) & 1);
+    const uint64_t highBit = 0 - (uint64_t) ((high >> b) & 1);
+    atLeastLow |= equalLow & count[b] & ~lowBit;
+    equalLow &= ~(count[b] ^ lowBit);
+    aboveHigh |= equalHigh & count[b] & ~highBit;
+    equalHigh &= ~(count[b] ^ highBit);
+  }
+  return (atLeastLow | equalLow) & ~aboveHigh;
+}
+
+// Bits of a bit-sliced count whose value is in a set (bit n for count n), one range compare per run of the set
+static inline uint64_t getCountInSet(const uint64_t* count, uint32_t set) {
+  uint64_t bits = 0;
+  while (set) {
+    const int low = getFirstBit((uint64_t) set);
+    const int high = low + getFirstBit((uint64_t) ~(set >> low)) - 1;
+    bits |= getCountInRange(count, low, high);
+    set &= high + 1 < 32 ? ~0u << (high + 1) : 0;
+  }
+  return bits;
+}
+
+AutomatonRule getThresholdRule(int threshold) {
+  AutomatonRule rule;
+  rule.birth = ((1u << 27) - 1) & (~0u << threshold);
+  rule.survival = rule.birth;
+  return rule;
+}
+
+void fillRandom(uint64_t* mask, float density, uint64_t seed) {
+  const int probability = (int) (density * 256.0f + 0.5f);
+  uint64_t state = seed;
+
+  for (int y = 0; y < CS_P; y++) {
+    for (int x = 0; x < CS_P; x++) {
+      if (x < 1 || x > CS_P - 2 || y < 1 || y > CS_P - 2) continue;
+
+      // Every random word halves the probability with an AND or raises it halfway to 1 with an OR,
+      // from the lowest bit of the 8-bit probability up (splitmix64)
+      uint64_t bits = probability >= 256 ? ~0ull : 0;
+      for (int b = 0; b < 8 && probability < 256; b++) {
+        state += 0x9E3779B97F4A7C15ull;
+        uint64_t random = state;
+        random = (random ^ (random >> 30)) * 0xBF58476D1CE4E5B9ull;
+        random = (random ^ (random >> 27)) * 0x94D049BB133111EBull;
+        random ^= random >> 31;
+        bits = ((probability >> b) & 1) ? bits | random : bits & random;
+      }
+      uint64_t& column = mask[y * CS_P + x];
+      column = (column & ~P_MASK) | (bits & P_MASK);
+    }
+  }
+}
+
+// Sum of each bit of a column with the bits below and above it in z, 2 planes
+static inline void sumColumn(const uint64_t column, uint64_t* sum) {
+  const uint64_t below = column << 1;
+  const uint64_t above = column >> 1;
+  sum[0] = below ^ column ^ above;
+  sum[1] = (below & column) | (above & (below ^ column));
+}
+
+// Sums of the 3x3 columns in z and x around every inner column of layer y, 4 planes each
+static inline void sumLayer(const uint64_t* mask, const int y, uint64_t (*sums)[4]) {
+  uint64_t columns[CS_P][2];
+  for (int x = 0; x < CS_P; x++) {
+    sumColumn(mask[y * CS_P + x], columns[x]);
+  }
+  for (int x = 1; x < CS_P - 1; x++) {
+    addSliced(columns[x - 1], columns[x], columns[x + 1], 2, sums[x]);
+  }
+}
+
+void stepAutomaton(const uint64_t* mask, uint64_t* result, const AutomatonRule& rule) {
+  // The counts include the voxel itself, which adds 1 for solid voxels
+  const uint32_t birth = rule.birth & ((1u << 27) - 1);
+  const uint32_t survival = (rule.survival << 1) & ((1u << 28) - 1);
+
+  // Rolling layer sums of y - 1, y and y + 1, and a copy of layer y for in place steps
+  uint64_t sums[3][CS_P][4];
+  uint64_t current[CS_P];
+  sumLayer(mask, 0, sums[0]);
+  sumLayer(mask, 1, sums[1]);
+
+  for (int y = 1; y < CS_P - 1; y++) {
+    for (int x = 0; x < CS_P; x++) {
+      current[x] = mask[y * CS_P + x];
+    }
+
+    uint64_t (*below)[4] = sums[(y - 1) % 3];
+    uint64_t (*layer)[4] = sums[y % 3];
+    uint64_t (*above)[4] = sums[(y + 1) % 3];
+    sumLayer(mask, y + 1, above);
+
+    for (int x = 1; x < CS_P - 1; x++) {
+      uint64_t count[COUNT_BITS + 1];
+      addSliced(below[x], layer[x], above[x], 4, count);
+
+      const uint64_t center = current[x];
+      const uint64_t alive = (center & getCountInSet(count, survival)) | (~center & getCountInSet(count, birth));
+      result[y * CS_P + x] = (center & ~P_MASK) | (alive & P_MASK);
+    }
+  }
+
+  if (result != mask) {
+    for (int x = 0; x < CS_P; x++) {
+      result[x] = mask[x];
+      result[(CS_P - 1) * CS_P + x] = mask[(CS_P - 1) * CS_P + x];
+    }
+    for (int y = 1; y < CS_P - 1; y++) {
+      result[y * CS_P] = mask[y * CS_P];
+      result[y * CS_P + CS_P - 1] = mask[y * CS_P + CS_P - 1];
+    }
+  }
+}
+
+// Dilates (or erodes the complement of) the inner voxels of a mask layer by layer. The previous layer of the
+// mask is kept so that result can be the same as mask.
+template <bool Erode>
+static inline void morphLayers(const uint64_t* mask, uint64_t* result, const Neighbourhood neighbourhood) {
+  uint64_t previous[CS_P];
+  uint64_t current[CS_P];
+  for (int x = 0; x < CS_P; x++) {
+    current[x] = Erode ? ~mask[x] : mask[x];
+  }
+
+  for (int y = 1; y < CS_P - 1; y++) {
+    for (int x = 0; x < CS_P; x++) {
+      previous[x] = current[x];
+      current[x] = Erode ? ~mask[y * CS_P + x] : mask[y * CS_P + x];
+    }
+    const uint64_t* next = mask + (y + 1) * CS_P;
+
+    for (int x = 1; x < CS_P - 1; x++) {
+      uint64_t grown;
+      if (neighbourhood == NEIGHBOURHOOD_6) {
+        const uint64_t nextColumn = Erode ? ~next[x] : next[x];
+        grown = current[x] | (current[x] << 1) | (current[x] >> 1) |
+          current[x - 1] | current[x + 1] | previous[x] | nextColumn;
+      }
+      else {
+        uint64_t rows = 0;
+        for (int i = x - 1; i <= x + 1; i++) {
+          rows |= previous[i] | current[i] | (Erode ? ~next[i] : next[i]);
+        }
+        grown = rows | (rows << 1) | (rows >> 1);
+      }
+
+      const uint64_t column = Erode ? ~current[x] : current[x];
+      result[y * CS_P + x] = (column & ~P_MASK) | ((Erode ? ~grown : grown) & P_MASK);
+    }
+  }
+
+  if (result != mask) {
+    for (int x = 0; x < CS_P; x++) {
+      result[x] = mask[x];
+      result[(CS_P - 1) * CS_P + x] = mask[(CS_P - 1) * CS_P + x];
+    }
+    for (int y = 1; y < CS_P - 1; y++) {
+      result[y * CS_P] = mask[y * CS_P];
+      result[y * CS_P + CS_P - 1] = mask[y * CS_P + CS_P - 1];
+    }
+  }
+}
+
+void dilateMask(const uint64_t* mask, uint64_t* result, Neighbourhood neighbourhood) {
+  morphLayers<false>(mask, result, neighbourhood);
+}
+
+void erodeMask(const uint64_t* mask, uint64_t* result, Neighbourhood neighbourhood) {
+  morphLayers<true>(mask, result, neighbourhood);
+}
+
+void openMask(const uint64_t* mask, uint64_t* result, Neighbourhood neighbourhood) {
+  morphLayers<true>(mask, result, neighbourhood);
+  morphLayers<false>(result, result, neighbourhood);
+}
+
+void closeMask(const uint64_t* mask, uint64_t* result, Neighbourhood neighbourhood) {
+  morphLayers<false>(mask, result, neighbourhood);
+  morphLayers<true>(result, result, neighbourhood);
+}
+
+void applyMaskToVoxels(const uint64_t* mask, uint8_t* voxels, uint8_t type) {
+  const uint64_t types = type * 0x0101010101010101ull;
+
+  for (int i = 0; i < CS_P2; i++) {
+    uint8_t* column = voxels + i * CS_P;
+    for (int z = 0; z < CS_P; z += 8) {
+      uint64_t bytes;
+      memcpy(&bytes, column + z, 8);
+
+      // 0xFF for the bytes that are 0
+      const uint64_t high = 0x7F7F7F7F7F7F7F7Full;
+      const uint64_t empty = ~(((bytes & high) + high) | bytes | high);
+      const uint64_t solid = getByteMask(mask[i] >> z);
+      bytes = (bytes & solid) | (types & solid & ((empty >> 7) * 0xFF));
+      memcpy(column + z, &bytes, 8);
+    }
+  }
+}
+
+#endif // AUTOMATA_IMPLEMENTATION_H
+#endif // BM_IMPLEMENTATION
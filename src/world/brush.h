@@ -0,0 +1,262 @@
+#ifndef BRUSH_H
+#define BRUSH_H
+
+//   Bulk edits of boxes, spheres, cylinders and arbitrary masks for explosions, stamping and terrain tools.
+//
+//   A brush is turned into one 64-bit z word per column of a chunk. The voxels to write are that word
+//   combined with the solid bits of the column, the bytes are written 8 at a time and the opaque mask is
+//   patched with the same word, so the mask never has to be rebuilt. Every chunk whose padded voxels overlap
+//   the brush is edited, padding included, and the chunks where a change is visible to the mesher are
+//   reported back.
+
+#include "../mesher.h"
+
+enum BrushShape {
+  BRUSH_BOX, // Voxels from min to max
+  BRUSH_SPHERE, // Voxels whose centre is within radius of center
+  BRUSH_CYLINDER, // Voxels from min[1] to max[1] whose centre is within radius of center in x and z
+  BRUSH_MASK, // Set bits of mask, placed at min
+};
+
+enum BrushOperation {
+  BRUSH_UNION, // Air in the brush becomes type
+  BRUSH_SUBTRACT, // Everything in the brush becomes air
+  BRUSH_REPLACE, // Non-air voxels in the brush become type
+};
+
+struct Brush {
+  BrushShape shape = BRUSH_BOX;
+  BrushOperation operation = BRUSH_UNION;
+  uint8_t type = 1;
+
+  // World voxel coordinates, voxel v spans v to v + 1
+  float center[3] = { 0, 0, 0 };
+  float radius = 0;
+
+  // Inclusive world voxel bounds. Masks are at most 64 voxels deep (z).
+  int min[3] = { 0, 0, 0 };
+  int max[3] = { 0, 0, 0 };
+
+  // BRUSH_MASK: one word per column ordered (y - min[1]) * width + (x - min[0]), bit z - min[2]
+  const uint64_t* mask = nullptr;
+};
+
+// A chunk that has to be meshed again after a brush
+struct ChunkEdit {
+  int chunk[3] = { 0, 0, 0 };
+  bool innerChanged = false; // Voxels of the inner 62^3 changed
+  uint8_t paddingFaces = 0; // Bit per face (+y, -y, +x, -x, +z, -z) whose padding layer changed opacity
+};
+
+// The voxels of a loaded chunk, see applyBrushWorld()
+struct BrushChunk {
+  uint8_t* voxels = nullptr; // 64^3 ZXY including the padding, nullptr if the chunk isn't loaded
+  uint64_t* opaqueMask = nullptr;
+};
+
+// Inclusive world voxel bounds of the voxels that a brush can touch
+void getBrushBounds(const Brush& brush, int* min, int* max);
+
+// Applies a brush to one chunk, padding included, and keeps opaqueMask in sync.
+//
+// @param[in] chunkPos: Chunk coordinates, the padded voxel 0 of the chunk is world voxel chunkPos * CS - 1.
+// @param[in] opaqueTypes: Like buildOpaqueMask(), nullptr treats every type except 0 as opaque.
+// @param[out] edit: Filled in for the chunk.
+// @return Whether the chunk has to be meshed again. Voxels in the padding that only changed type are
+// written but don't count, the mesher only reads the opacity of the padding.
+bool applyBrush(const Brush& brush, const int* chunkPos, const uint8_t* opaqueTypes, uint8_t* voxels, uint64_t* opaqueMask, ChunkEdit& edit);
+
+// Chunk coordinate of a world voxel
+static inline int getBrushChunk(const int voxel) {
+  return voxel >= 0 ? voxel / CS : (voxel + 1) / CS - 1;
+}
+
+// Applies a brush to every loaded chunk that it overlaps.
+//
+// @param[in] getChunk: BrushChunk getChunk(int x, int y, int z) for chunk coordinates.
+// @param[out] edits: Cleared, then holds the chunks that have to be meshed again. A chunk with paddingFaces
+// set also needs those ChunkBorders refreshed when it's meshed with meshWithBorders().
+template <typename GetChunk>
+void applyBrushWorld(const Brush& brush, const uint8_t* opaqueTypes, GetChunk getChunk, BM_VECTOR<ChunkEdit>& edits) {
+  edits.clear();
+
+  int min[3], max[3];
+  getBrushBounds(brush, min, max);
+  if (min[0] > max[0] || min[1] > max[1] || min[2] > max[2]) return;
+
+  // The padded voxels of chunk c are c * CS - 1 to c * CS + CS
+  int chunkMin[3], chunkMax[3];
+  for (int axis = 0; axis < 3; axis++) {
+    chunkMin[axis] = getBrushChunk(min[axis] - 1);
+    chunkMax[axis] = getBrushChunk(max[axis] + 1);
+  }
+
+  for (int y = chunkMin[1]; y <= chunkMax[1]; y++) {
+    for (int z = chunkMin[2]; z <= chunkMax[2]; z++) {
+      for (int x = chunkMin[0]; x <= chunkMax[0]; x++) {
+        BrushChunk chunk = getChunk(x, y, z);
+        if (!chunk.voxels) continue;
+
+        const int chunkPos[3] = { x, y, z };
+        ChunkEdit edit;
+        if (applyBrush(brush, chunkPos, opaqueTypes, chunk.voxels, chunk.opaqueMask, edit)) {
+          edits.push_back(edit);
+        }
+      }
+    }
+  }
+}
+
+#endif // BRUSH_H
+
+#ifdef BM_IMPLEMENTATION
+#ifndef BRUSH_IMPLEMENTATION_H
+#define BRUSH_IMPLEMENTATION_H
+
+#include <math.h> // sqrtf, ceilf, floorf
+
+// Voxels whose centre is within extent of center along one axis
+static inline void getBrushRange(const float center, const float extent, int& begin, int& end) {
+  begin = (int) ceilf(center - extent - 0.5f);
+  end = (int) floorf(center + extent - 0.5f);
+}
+
+// Bits of the world voxels begin to end (inclusive) in a chunk column starting at world z chunkZ
+static inline uint64_t getBrushBits(int begin, int end, const int chunkZ) {
+  begin = begin - chunkZ > 0 ? begin - chunkZ : 0;
+  end = end - chunkZ < CS_P - 1 ? end - chunkZ : CS_P - 1;
+  if (begin > end) return 0;
+  return (~0ull >> (CS_P - 1 - end)) & (~0ull << begin);
+}
+
+void getBrushBounds(const Brush& brush, int* min, int* max) {
+  for (int axis = 0; axis < 3; axis++) {
+    min[axis] = brush.min[axis];
+    max[axis] = brush.max[axis];
+  }
+
+  switch (brush.shape) {
+    case BRUSH_SPHERE:
+      for (int axis = 0; axis < 3; axis++) {
+        getBrushRange(brush.center[axis], brush.radius, min[axis], max[axis]);
+      }
+      break;
+    case BRUSH_CYLINDER:
+      getBrushRange(brush.center[0], brush.radius, min[0], max[0]);
+      getBrushRange(brush.center[2], brush.radius, min[2], max[2]);
+      break;
+    case BRUSH_MASK:
+      if (max[2] > min[2] + CS_P - 1) max[2] = min[2] + CS_P - 1;
+      break;
+    default:
+      break;
+  }
+}
+
+// Bits of the chunk column at world x, y (starting at world z chunkZ) that are inside the brush
+static inline uint64_t getBrushColumn(const Brush& brush, const int x, const int y, const int chunkZ) {
+  switch (brush.shape) {
+    case BRUSH_BOX:
+      return getBrushBits(brush.min[2], brush.max[2], chunkZ);
+
+    case BRUSH_SPHERE:
+    case BRUSH_CYLINDER: {
+      const float dx = x + 0.5f - brush.center[0];
+      const float dy = brush.shape == BRUSH_SPHERE ? y + 0.5f - brush.center[1] : 0.0f;
+      const float remaining = brush.radius * brush.radius - dx * dx - dy * dy;
+      if (remaining < 0) return 0;
+
+      int begin, end;
+      getBrushRange(brush.center[2], sqrtf(remaining), begin, end);
+      return getBrushBits(begin, end, chunkZ);
+    }
+
+    case BRUSH_MASK: {
+      const int width = brush.max[0] - brush.min[0] + 1;
+      const uint64_t column = brush.mask[(y - brush.min[1]) * width + (x - brush.min[0])];
+      const int shift = brush.min[2] - chunkZ;
+      if (shift <= -CS_P || shift >= CS_P) return 0;
+
+      const uint64_t bits = shift >= 0 ? column << shift : column >> -shift;
+      return bits & getBrushBits(brush.min[2], brush.max[2], chunkZ);
+    }
+  }
+  return 0;
+}
+
+bool applyBrush(const Brush& brush, const int* chunkPos, const uint8_t* opaqueTypes, uint8_t* voxels, uint64_t* opaqueMask, ChunkEdit& edit) {
+  edit = ChunkEdit();
+  for (int axis = 0; axis < 3; axis++) {
+    edit.chunk[axis] = chunkPos[axis];
+  }
+
+  int min[3], max[3];
+  getBrushBounds(brush, min, max);
+
+  // World voxel of padded voxel 0
+  int origin[3];
+  int begin[3], end[3];
+  for (int axis = 0; axis < 3; axis++) {
+    origin[axis] = chunkPos[axis] * CS - 1;
+    begin[axis] = min[axis] - origin[axis] > 0 ? min[axis] - origin[axis] : 0;
+    end[axis] = max[axis] - origin[axis] < CS_P - 1 ? max[axis] - origin[axis] : CS_P - 1;
+    if (begin[axis] > end[axis]) return false;
+  }
+
+  const uint8_t type = brush.operation == BRUSH_SUBTRACT ? 0 : brush.type;
+  const uint64_t types = type * 0x0101010101010101ull;
+  const bool opaque = opaqueTypes ? opaqueTypes[type] : type != 0;
+
+  uint8_t typeColumn[CS_P];
+  BM_MEMSET(typeColumn, type, CS_P);
+
+  for (int y = begin[1]; y <= end[1]; y++) {
+    for (int x = begin[0]; x <= end[0]; x++) {
+      uint64_t write = getBrushColumn(brush, origin[0] + x, origin[1] + y, origin[2]);
+      if (!write) continue;
+
+      const int i = y * CS_P + x;
+      uint8_t* column = voxels + i * CS_P;
+      const uint64_t solid = getOpaqueColumn(column);
+
+      switch (brush.operation) {
+        case BRUSH_UNION: write &= type ? ~solid : 0; break;
+        case BRUSH_SUBTRACT: write &= solid; break;
+        case BRUSH_REPLACE: write &= solid & ~getEqualBytes(column, typeColumn); break;
+      }
+      if (!write) continue;
+
+      for (int z = getFirstBit(write) & ~7; z < CS_P; z += 8) {
+        const uint64_t bytes = getByteMask(write >> z);
+        if (!bytes) continue;
+
+        uint64_t current;
+        memcpy(&current, column + z, 8);
+        current = (current & ~bytes) | (types & bytes);
+        memcpy(column + z, &current, 8);
+      }
+
+      // All written voxels have the same type, so their opacity is patched with one word
+      const uint64_t previous = opaqueMask[i];
+      opaqueMask[i] = opaque ? previous | write : previous & ~write;
+      const uint64_t changed = previous ^ opaqueMask[i];
+
+      // The mesher reads the padding only next to the inner voxels, along one axis
+      const bool innerX = x > 0 && x < CS_P - 1;
+      const bool innerY = y > 0 && y < CS_P - 1;
+      if (innerX && innerY) {
+        edit.innerChanged |= (write & P_MASK) != 0;
+        edit.paddingFaces |= (uint8_t) (((changed >> (CS_P - 1)) & 1) << 4 | (changed & 1) << 5);
+      }
+      else if (innerX != innerY && (changed & P_MASK)) {
+        const int face = innerX ? (y ? 0 : 1) : (x ? 2 : 3);
+        edit.paddingFaces |= 1 << face;
+      }
+    }
+  }
+
+  return edit.innerChanged || edit.paddingFaces;
+}
+
+#endif // BRUSH_IMPLEMENTATION_H
+#endif // BM_IMPLEMENTATION
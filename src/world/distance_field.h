@@ -0,0 +1,176 @@
+#ifndef DISTANCE_FIELD_H
+#define DISTANCE_FIELD_H
+
+//   Distance from every voxel to the nearest solid voxel of the occupancy mask (MeshData::opaqueMask), for
+//   steering, soft shadows and ray marching.
+//
+//   The voxels within distance d of a solid voxel are the solid voxels dilated d times, and every dilation
+//   is a few shifts and ORs of 64-bit column words. Distances are capped at MAX_DISTANCE and stored in
+//   four bit-sliced planes like the light levels of lighting.h. Only the padding ring of the neighbouring
+//   chunks is seen, so distances near the chunk border can be larger than in the world.
+
+#include "../mesher.h"
+
+static constexpr int DISTANCE_BITS = 4;
+static constexpr int MAX_DISTANCE = (1 << DISTANCE_BITS) - 1;
+
+enum DistanceMetric {
+  DISTANCE_MANHATTAN, // 6 neighbours per step
+  DISTANCE_CHEBYSHEV, // 26 neighbours per step
+};
+
+struct DistanceField {
+  DistanceMetric metric = DISTANCE_MANHATTAN;
+  uint64_t* planes[DISTANCE_BITS] = { nullptr }; // CS_P2 each, bit z of [y * CS_P + x] is bit b of the distance of the voxel
+};
+
+// @param[out] field: planes are overwritten. Voxels in the padding are 0 if solid and MAX_DISTANCE otherwise.
+void buildDistanceField(const uint64_t* opaqueMask, DistanceField& field);
+
+// Updates the distances around the voxel at x, y, z (padded, 1-62) after it was edited in opaqueMask.
+// Distances change at most MAX_DISTANCE - 1 voxels away, so only that box is built again.
+void updateDistanceField(const uint64_t* opaqueMask, DistanceField& field, int x, int y, int z);
+
+// Distance of the voxel at x, y, z (padded), 0 for solid voxels
+int getDistance(const DistanceField& field, int x, int y, int z);
+
+// Bits of the column at x, y (0-63) that are at most distance away from a solid voxel.
+// The complement is the voxels with more than distance voxels of clearance.
+uint64_t getVoxelsWithin(const DistanceField& field, int x, int y, int distance);
+
+#endif // DISTANCE_FIELD_H
+
+#ifdef BM_IMPLEMENTATION
+#ifndef DISTANCE_FIELD_IMPLEMENTATION_H
+#define DISTANCE_FIELD_IMPLEMENTATION_H
+
+// Bits of a column whose distance is at most distance, a bit-sliced compare against a constant
+static inline uint64_t getDistanceAtMost(const DistanceField& field, const int i, const int distance) {
+  uint64_t less = 0;
+  uint64_t equal = ~0ull;
+  for (int b = DISTANCE_BITS - 1; b >= 0; b--) {
+    const uint64_t plane = field.planes[b][i];
+    const uint64_t distanceBit = 0 - (uint64_t) ((distance >> b) & 1);
+    less |= equal & ~plane & distanceBit;
+    equal &= ~(plane ^ distanceBit);
+  }
+  return less | equal;
+}
+
+// Builds the distances of the bits in zMask of the columns x in [xBegin, xEnd), y in [yBegin, yEnd) (1-62),
+// reading the rest of the field as it is.
+//
+// The voxels further than d for d = 0..MAX_DISTANCE - 1 are a thermometer code of the distance, bit b of
+// the distance is the parity of the sets with d + 1 a multiple of 2^b.
+static void buildDistanceRegion(const uint64_t* opaqueMask, DistanceField& field,
+  const int xBegin, const int xEnd, const int yBegin, const int yEnd, const uint64_t zMask) {
+  uint64_t levels[2][CS_P2];
+  // Columns with distances below MAX_DISTANCE outside of the region that have to be read back
+  uint8_t hasDistances[CS_P2];
+
+  for (int y = yBegin - 1; y <= yEnd; y++) {
+    for (int x = xBegin - 1; x <= xEnd; x++) {
+      const int i = y * CS_P + x;
+      const bool inside = x >= xBegin && x < xEnd && y >= yBegin && y < yEnd;
+      const uint64_t outside = inside ? ~zMask : ~0ull;
+      uint64_t far = ~0ull;
+      for (int b = 0; b < DISTANCE_BITS; b++) {
+        far &= field.planes[b][i];
+        if (inside) field.planes[b][i] &= ~zMask;
+      }
+      hasDistances[i] = (far & outside) != outside;
+    }
+  }
+
+  int current = 0;
+  for (int distance = 0; distance < MAX_DISTANCE; distance++) {
+    uint64_t* within = levels[current];
+    uint64_t* next = levels[current ^ 1];
+
+    // The 26 neighbours are the 3x3 columns around a voxel after spreading each of them along z
+    if (distance && field.metric == DISTANCE_CHEBYSHEV) {
+      for (int y = yBegin - 1; y <= yEnd; y++) {
+        for (int x = xBegin - 1; x <= xEnd; x++) {
+          const int i = y * CS_P + x;
+          within[i] |= (within[i] << 1) | (within[i] >> 1);
+        }
+      }
+    }
+
+    uint64_t covered = ~0ull;
+    for (int y = yBegin - 1; y <= yEnd; y++) {
+      for (int x = xBegin - 1; x <= xEnd; x++) {
+        const int i = y * CS_P + x;
+        const uint64_t stored = hasDistances[i] ? getDistanceAtMost(field, i, distance) : 0;
+
+        if (x < xBegin || x >= xEnd || y < yBegin || y >= yEnd) {
+          next[i] = stored;
+          continue;
+        }
+
+        uint64_t reached;
+        if (!distance) {
+          reached = opaqueMask[i];
+        }
+        else if (field.metric == DISTANCE_CHEBYSHEV) {
+          reached = within[i - CS_P - 1] | within[i - CS_P] | within[i - CS_P + 1] |
+            within[i - 1] | within[i] | within[i + 1] |
+            within[i + CS_P - 1] | within[i + CS_P] | within[i + CS_P + 1];
+        }
+        else {
+          reached = within[i] | (within[i] << 1) | (within[i] >> 1) |
+            within[i - 1] | within[i + 1] | within[i - CS_P] | within[i + CS_P];
+        }
+        reached &= zMask;
+        next[i] = reached | (stored & ~zMask);
+        covered &= reached | ~zMask;
+
+        // Bit b of the distance flips with every set of further voxels whose d + 1 is a multiple of 2^b
+        const uint64_t further = ~reached & zMask;
+        for (int b = 0; b < DISTANCE_BITS; b++) {
+          if (!((distance + 1) & ((1 << b) - 1))) field.planes[b][i] ^= further;
+        }
+      }
+    }
+
+    // All voxels of the region are reached, the remaining sets are empty
+    if (covered == ~0ull) break;
+    current ^= 1;
+  }
+}
+
+void buildDistanceField(const uint64_t* opaqueMask, DistanceField& field) {
+  for (int b = 0; b < DISTANCE_BITS; b++) {
+    for (int i = 0; i < CS_P2; i++) {
+      field.planes[b][i] = ~opaqueMask[i];
+    }
+  }
+  buildDistanceRegion(opaqueMask, field, 1, CS_P - 1, 1, CS_P - 1, P_MASK);
+}
+
+void updateDistanceField(const uint64_t* opaqueMask, DistanceField& field, int x, int y, int z) {
+  static constexpr int reach = MAX_DISTANCE - 1;
+  const int xBegin = x - reach > 1 ? x - reach : 1;
+  const int xEnd = x + reach + 1 < CS_P - 1 ? x + reach + 1 : CS_P - 1;
+  const int yBegin = y - reach > 1 ? y - reach : 1;
+  const int yEnd = y + reach + 1 < CS_P - 1 ? y + reach + 1 : CS_P - 1;
+  const int zBegin = z - reach > 0 ? z - reach : 0;
+  const int zEnd = z + reach + 1 < CS_P ? z + reach + 1 : CS_P;
+  const uint64_t zMask = (~0ull >> (CS_P - zEnd)) & (~0ull << zBegin) & P_MASK;
+  buildDistanceRegion(opaqueMask, field, xBegin, xEnd, yBegin, yEnd, zMask);
+}
+
+int getDistance(const DistanceField& field, int x, int y, int z) {
+  int distance = 0;
+  for (int b = 0; b < DISTANCE_BITS; b++) {
+    distance |= (int) ((field.planes[b][y * CS_P + x] >> z) & 1) << b;
+  }
+  return distance;
+}
+
+uint64_t getVoxelsWithin(const DistanceField& field, int x, int y, int distance) {
+  return getDistanceAtMost(field, y * CS_P + x, distance);
+}
+
+#endif // DISTANCE_FIELD_IMPLEMENTATION_H
+#endif // BM_IMPLEMENTATION
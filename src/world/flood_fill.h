@@ -0,0 +1,285 @@
+#ifndef FLOOD_FILL_H
+#define FLOOD_FILL_H
+
+//   Bit-parallel flood fill and connected components of occupancy masks, for example the solid voxels of
+//   MeshData::opaqueMask to find floating blocks, or its complement to find caves.
+//
+//   Fills spread along a whole 64-bit column at once and from column to column with ANDs of the column
+//   words, voxels are 6-connected. Only the inner voxels of a chunk are filled, the padding ring tells
+//   where a fill continues into the neighbouring chunks.
+
+#include "../mesher.h"
+
+// Fills the voxels of mask that are connected to the seed voxel.
+//
+// @param[in] mask: CS_P2 columns like opaqueMask.
+// @param[in,out] filled: CS_P2, voxels that are already set count as filled and are not crossed again.
+// @param[in] x, y, z: Seed voxel in padded coordinates (1-62).
+// @return The number of voxels that were filled.
+int floodFill(const uint64_t* mask, uint64_t* filled, int x, int y, int z);
+
+// Same as above, starting from all voxels of seeds (CS_P2), as returned by getFloodFillSeeds().
+int floodFill(const uint64_t* mask, uint64_t* filled, const uint64_t* seeds);
+
+// Finds where a fill continues into the neighbouring chunk in the direction of face (mesher face order):
+// the filled voxels on that border whose neighbour in the padding is in the mask.
+//
+// @param[out] seeds: CS_P2, the voxels of the neighbouring chunk to continue the fill from.
+// @return Whether there are any seeds.
+bool getFloodFillSeeds(const uint64_t* mask, const uint64_t* filled, int face, uint64_t* seeds);
+
+struct ChunkComponents {
+  uint32_t* labels = nullptr; // CS_P3 in the ZXY order of voxels, component id or 0 outside of the mask
+  BM_VECTOR<int> sizes; // Voxels of component id - 1
+  BM_VECTOR<uint8_t> faces; // Faces (bit per face) through which component id - 1 continues into neighbouring chunks
+  int count = 0;
+};
+
+// Labels the 6-connected components of the inner voxels of mask with ids from 1 to components.count.
+// Components with no faces set are enclosed in the chunk, a solid one of them is floating.
+void labelComponents(const uint64_t* mask, ChunkComponents& components);
+
+struct ComponentLink {
+  uint32_t id; // Component of the chunk
+  uint32_t neighbourId; // Component of the neighbouring chunk
+};
+
+// Finds the components that connect across the border of two neighbouring chunks. Merging the links of all
+// borders, for example with a union-find over (chunk, id), gives the components of the world.
+//
+// @param[in] face: Direction of the neighbouring chunk in mesher face order.
+// @param[out] links: Cleared and filled with unique links.
+void getComponentLinks(const ChunkComponents& components, const ChunkComponents& neighbour, int face, BM_VECTOR<ComponentLink>& links);
+
+#endif // FLOOD_FILL_H
+
+#ifdef BM_IMPLEMENTATION
+#ifndef FLOOD_FILL_IMPLEMENTATION_H
+#define FLOOD_FILL_IMPLEMENTATION_H
+
+#include <algorithm> // std::sort, std::unique
+
+// Grows bits over the runs of mask that they are in, in both directions of the column (Kogge-Stone fill)
+static inline uint64_t fillColumnRuns(const uint64_t mask, const uint64_t bits) {
+  uint64_t up = bits;
+  uint64_t upMask = mask;
+  uint64_t down = bits;
+  uint64_t downMask = mask;
+  for (int shift = 1; shift < 64; shift <<= 1) {
+    up |= upMask & (up << shift);
+    upMask &= upMask << shift;
+    down |= downMask & (down >> shift);
+    downMask &= downMask >> shift;
+  }
+  return up | down;
+}
+
+// Mask bits of a column that fills may enter, the inner voxels
+static inline uint64_t getFillableColumn(const uint64_t* mask, const int i) {
+  const int x = i % CS_P;
+  const int y = i / CS_P;
+  return (x > 0 && x < CS_P - 1 && y > 0 && y < CS_P - 1) ? mask[i] & P_MASK : 0;
+}
+
+// Fills from the columns on the stack, which already hold their new bits in filled and in pending.
+// Only the new bits spread, and the runs they grow over stop at voxels that are already filled.
+// Calls visit(column, bits) for the new bits of every column.
+template <typename Visit>
+static inline int fillRegion(const uint64_t* mask, uint64_t* filled, int* stack, int stackSize, uint64_t* pending, Visit visit) {
+  static constexpr int neighbours[4] = { 1, -1, CS_P, -CS_P };
+  int count = 0;
+
+  while (stackSize) {
+    const int i = stack[--stackSize];
+    const uint64_t bits = pending[i];
+    pending[i] = 0;
+
+    for (int j = 0; j < 4; j++) {
+      const int n = i + neighbours[j];
+      const uint64_t open = getFillableColumn(mask, n) & ~filled[n];
+      const uint64_t added = bits & open;
+      if (!added) continue;
+
+      const uint64_t grown = fillColumnRuns(open, added);
+      filled[n] |= grown;
+      count += getBitCount(grown);
+      visit(n, grown);
+
+      if (!pending[n]) {
+        stack[stackSize++] = n;
+      }
+      pending[n] |= grown;
+    }
+  }
+
+  return count;
+}
+
+int floodFill(const uint64_t* mask, uint64_t* filled, int x, int y, int z) {
+  uint64_t seeds[CS_P2] = { 0 };
+  seeds[y * CS_P + x] = 1ull << z;
+  return floodFill(mask, filled, seeds);
+}
+
+int floodFill(const uint64_t* mask, uint64_t* filled, const uint64_t* seeds) {
+  int stack[CS_P2];
+  uint64_t pending[CS_P2] = { 0 };
+  int stackSize = 0;
+  int count = 0;
+
+  for (int i = 0; i < CS_P2; i++) {
+    const uint64_t open = getFillableColumn(mask, i) & ~filled[i];
+    const uint64_t added = seeds[i] & open;
+    if (!added) continue;
+
+    const uint64_t grown = fillColumnRuns(open, added);
+    filled[i] |= grown;
+    count += getBitCount(grown);
+    pending[i] = grown;
+    stack[stackSize++] = i;
+  }
+
+  return count + fillRegion(mask, filled, stack, stackSize, pending, [](int, uint64_t) {});
+}
+
+bool getFloodFillSeeds(const uint64_t* mask, const uint64_t* filled, int face, uint64_t* seeds) {
+  BM_MEMSET(seeds, 0, CS_P2 * sizeof(uint64_t));
+  uint64_t any = 0;
+
+  for (int a = 1; a < CS_P - 1; a++) {
+    switch (face) {
+      case 0: {
+        const uint64_t bits = filled[(CS_P - 2) * CS_P + a] & mask[(CS_P - 1) * CS_P + a];
+        seeds[CS_P + a] = bits;
+        any |= bits;
+        break;
+      }
+      case 1: {
+        const uint64_t bits = filled[CS_P + a] & mask[a];
+        seeds[(CS_P - 2) * CS_P + a] = bits;
+        any |= bits;
+        break;
+      }
+      case 2: {
+        const uint64_t bits = filled[a * CS_P + CS_P - 2] & mask[a * CS_P + CS_P - 1];
+        seeds[a * CS_P + 1] = bits;
+        any |= bits;
+        break;
+      }
+      case 3: {
+        const uint64_t bits = filled[a * CS_P + 1] & mask[a * CS_P];
+        seeds[a * CS_P + CS_P - 2] = bits;
+        any |= bits;
+        break;
+      }
+      default: {
+        for (int b = 1; b < CS_P - 1; b++) {
+          const int i = a * CS_P + b;
+          if (face == 4) {
+            const uint64_t bit = (filled[i] >> (CS_P - 2)) & (mask[i] >> (CS_P - 1)) & 1;
+            seeds[i] = bit << 1;
+            any |= bit;
+          }
+          else {
+            const uint64_t bit = (filled[i] >> 1) & mask[i] & 1;
+            seeds[i] = bit << (CS_P - 2);
+            any |= bit;
+          }
+        }
+        break;
+      }
+    }
+  }
+
+  return any != 0;
+}
+
+// Faces through which the new bits of a column continue into neighbouring chunks
+static inline uint8_t getComponentFaces(const uint64_t* mask, const int i, const uint64_t bits) {
+  const int x = i % CS_P;
+  const int y = i / CS_P;
+  uint8_t faces = 0;
+  if (y == CS_P - 2 && (bits & mask[i + CS_P])) faces |= 1 << 0;
+  if (y == 1 && (bits & mask[i - CS_P])) faces |= 1 << 1;
+  if (x == CS_P - 2 && (bits & mask[i + 1])) faces |= 1 << 2;
+  if (x == 1 && (bits & mask[i - 1])) faces |= 1 << 3;
+  if ((bits >> (CS_P - 2)) & (mask[i] >> (CS_P - 1)) & 1) faces |= 1 << 4;
+  if ((bits >> 1) & mask[i] & 1) faces |= 1 << 5;
+  return faces;
+}
+
+void labelComponents(const uint64_t* mask, ChunkComponents& components) {
+  BM_MEMSET(components.labels, 0, CS_P3 * sizeof(uint32_t));
+  components.sizes.clear();
+  components.faces.clear();
+  components.count = 0;
+
+  uint64_t filled[CS_P2] = { 0 };
+  int stack[CS_P2];
+  uint64_t pending[CS_P2] = { 0 };
+
+  for (int i = 0; i < CS_P2; i++) {
+    while (true) {
+      const uint64_t remaining = getFillableColumn(mask, i) & ~filled[i];
+      if (!remaining) break;
+
+      // Start a new component at the lowest unfilled voxel of the column
+      const uint32_t id = ++components.count;
+      uint8_t faces = 0;
+      auto visit = [&](const int column, uint64_t bits) {
+        faces |= getComponentFaces(mask, column, bits);
+        uint32_t* labels = components.labels + column * CS_P;
+        while (bits) {
+          labels[getFirstBit(bits)] = id;
+          bits &= bits - 1;
+        }
+      };
+
+      const uint64_t grown = fillColumnRuns(remaining, remaining & (~remaining + 1));
+      filled[i] |= grown;
+      visit(i, grown);
+
+      stack[0] = i;
+      pending[i] = grown;
+      const int size = getBitCount(grown) + fillRegion(mask, filled, stack, 1, pending, visit);
+
+      components.sizes.push_back(size);
+      components.faces.push_back(faces);
+    }
+  }
+}
+
+void getComponentLinks(const ChunkComponents& components, const ChunkComponents& neighbour, int face, BM_VECTOR<ComponentLink>& links) {
+  links.clear();
+
+  // Border layer of the chunk and the matching layer of the neighbour along the axis of the face
+  const int axis = face < 2 ? 1 : face < 4 ? 0 : 2;
+  const int layer = (face & 1) ? 1 : CS_P - 2;
+  const int neighbourLayer = (face & 1) ? CS_P - 2 : 1;
+  static constexpr int strides[3] = { CS_P, CS_P2, 1 };
+
+  for (int a = 1; a < CS_P - 1; a++) {
+    for (int b = 1; b < CS_P - 1; b++) {
+      int i = 0;
+      for (int j = 0, k = 0; j < 3; j++) {
+        if (j != axis) i += (k++ ? b : a) * strides[j];
+      }
+
+      const uint32_t id = components.labels[i + layer * strides[axis]];
+      const uint32_t neighbourId = neighbour.labels[i + neighbourLayer * strides[axis]];
+      if (id && neighbourId && (!links.size() || links.back().id != id || links.back().neighbourId != neighbourId)) {
+        links.push_back({ id, neighbourId });
+      }
+    }
+  }
+
+  std::sort(links.begin(), links.end(), [](const ComponentLink& l, const ComponentLink& r) {
+    return l.id != r.id ? l.id < r.id : l.neighbourId < r.neighbourId;
+  });
+  links.erase(std::unique(links.begin(), links.end(), [](const ComponentLink& l, const ComponentLink& r) {
+    return l.id == r.id && l.neighbourId == r.neighbourId;
+  }), links.end());
+}
+
+#endif // FLOOD_FILL_IMPLEMENTATION_H
+#endif // BM_IMPLEMENTATION
@@ -0,0 +1,128 @@
+#ifndef HEIGHTMAP_H
+#define HEIGHTMAP_H
+
+//   The highest solid voxel of every vertical column of a chunk and of stacks of chunks, for sky light, rain
+//   occlusion and minimaps.
+//
+//   The columns of opaqueMask run along z while up is y, so the mask is transposed 64x64 bits at a time
+//   into columns that run along y. The top of a column is then one clz, and an edited voxel is one bit.
+
+#include "../mesher.h"
+
+struct SkyHeightmap {
+  uint64_t* columns = nullptr; // CS_P2 ordered (x * CS_P) + z, bit y is set for the solid inner layers (y 1-62) of the column
+  uint8_t* heights = nullptr; // CS_P2 ordered like columns, padded y above the highest solid voxel, 0 for empty columns
+};
+
+// Builds the heightmap of a chunk from its occupancy mask. The padding columns around the 62x62 inner
+// columns are included, the padding layers above and below are not.
+void buildSkyHeightmap(const uint64_t* opaqueMask, SkyHeightmap& heightmap);
+
+// Updates the column of a voxel at x, y, z (padded, y 1-62) that became solid or air, in O(1)
+void updateSkyHeightmap(SkyHeightmap& heightmap, int x, int y, int z, bool solid);
+
+// Updates the heightmap after the opaqueMask column at x, y (0-63) has been edited,
+// see updateOpaqueMaskColumn(). Changes one bit in each of the CS_P columns that it crosses.
+void updateSkyHeightmapColumn(const uint64_t* opaqueMask, SkyHeightmap& heightmap, int x, int y);
+
+// Finds the top of the column x, z (padded) in a vertical stack of chunks.
+//
+// @param[in] chunks: Heightmaps of the stack from the top down, nullptr for chunks that are empty or not loaded.
+// @param[in] topChunkY: Chunk y of chunks[0].
+// @return The world y above the highest solid voxel, or the world y of the bottom of the stack if the
+// column is empty in all chunks.
+int getStackHeight(const SkyHeightmap* const* chunks, int count, int topChunkY, int x, int z);
+
+// Same as above for all CS_P2 columns, ordered (x * CS_P) + z
+void getStackHeights(const SkyHeightmap* const* chunks, int count, int topChunkY, int* heights);
+
+#endif // HEIGHTMAP_H
+
+#ifdef BM_IMPLEMENTATION
+#ifndef HEIGHTMAP_IMPLEMENTATION_H
+#define HEIGHTMAP_IMPLEMENTATION_H
+
+// Transposes a 64x64 bit matrix in place, bit j of row i moves to bit i of row j
+static inline void transposeBits(uint64_t* rows) {
+  uint64_t mask = 0x00000000FFFFFFFFull;
+  for (int j = 32; j != 0; j >>= 1, mask ^= mask << j) {
+    for (int k = 0; k < 64; k = ((k | j) + 1) & ~j) {
+      const uint64_t swapped = ((rows[k] >> j) ^ rows[k | j]) & mask;
+      rows[k] ^= swapped << j;
+      rows[k | j] ^= swapped;
+    }
+  }
+}
+
+static inline uint8_t getColumnHeight(const uint64_t column) {
+  return column ? getLastBit(column) + 1 : 0;
+}
+
+void buildSkyHeightmap(const uint64_t* opaqueMask, SkyHeightmap& heightmap) {
+  uint64_t rows[CS_P];
+
+  for (int x = 0; x < CS_P; x++) {
+    rows[0] = 0;
+    rows[CS_P - 1] = 0;
+    for (int y = 1; y < CS_P - 1; y++) {
+      rows[y] = opaqueMask[y * CS_P + x];
+    }
+
+    transposeBits(rows);
+
+    for (int z = 0; z < CS_P; z++) {
+      heightmap.columns[x * CS_P + z] = rows[z];
+      heightmap.heights[x * CS_P + z] = getColumnHeight(rows[z]);
+    }
+  }
+}
+
+void updateSkyHeightmap(SkyHeightmap& heightmap, int x, int y, int z, bool solid) {
+  const int i = x * CS_P + z;
+  heightmap.columns[i] = (heightmap.columns[i] & ~(1ull << y)) | ((uint64_t) solid << y);
+  heightmap.heights[i] = getColumnHeight(heightmap.columns[i]);
+}
+
+void updateSkyHeightmapColumn(const uint64_t* opaqueMask, SkyHeightmap& heightmap, int x, int y) {
+  if (y < 1 || y > CS_P - 2) return;
+
+  const uint64_t bits = opaqueMask[y * CS_P + x];
+  for (int z = 0; z < CS_P; z++) {
+    updateSkyHeightmap(heightmap, x, y, z, (bits >> z) & 1);
+  }
+}
+
+int getStackHeight(const SkyHeightmap* const* chunks, int count, int topChunkY, int x, int z) {
+  for (int i = 0; i < count; i++) {
+    if (!chunks[i]) continue;
+
+    const uint8_t height = chunks[i]->heights[x * CS_P + z];
+    if (height) return (topChunkY - i) * CS + height - 1;
+  }
+  return (topChunkY - count + 1) * CS;
+}
+
+void getStackHeights(const SkyHeightmap* const* chunks, int count, int topChunkY, int* heights) {
+  const int bottom = (topChunkY - count + 1) * CS;
+  for (int i = 0; i < CS_P2; i++) {
+    heights[i] = bottom;
+  }
+
+  // Columns are settled by the highest chunk that has a solid voxel in them
+  uint8_t settled[CS_P2] = { 0 };
+  for (int i = 0; i < count; i++) {
+    if (!chunks[i]) continue;
+
+    const int chunkBottom = (topChunkY - i) * CS - 1;
+    for (int j = 0; j < CS_P2; j++) {
+      const uint8_t height = chunks[i]->heights[j];
+      if (height && !settled[j]) {
+        heights[j] = chunkBottom + height;
+        settled[j] = 1;
+      }
+    }
+  }
+}
+
+#endif // HEIGHTMAP_IMPLEMENTATION_H
+#endif // BM_IMPLEMENTATION
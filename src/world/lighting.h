@@ -0,0 +1,251 @@
+#ifndef LIGHTING_H
+#define LIGHTING_H
+
+//   Block light and sky light stored as bit-sliced planes that line up with the columns of the occupancy mask
+//   (MeshData::opaqueMask).
+//
+//   Light spreads one level at a time: the voxels with at least level k are the sources of level k, the
+//   voxels with at least level k + 1 and the air next to them. That is a 6-neighbour dilation of 64 voxels
+//   per column word, so a chunk is lit in 15 passes over its columns instead of a voxel by voxel BFS.
+//   The padding ring holds the light of the neighbouring chunks, it is read but never propagated into.
+
+#include "../mesher.h"
+
+static constexpr int LIGHT_BITS = 4;
+static constexpr int MAX_LIGHT_LEVEL = (1 << LIGHT_BITS) - 1;
+
+// Quads of regular chunks store a light level in the spare bits 58-61, see setQuadLight()
+static constexpr int QUAD_LIGHT_SHIFT = 58;
+
+struct LightVolume {
+  uint64_t* planes[LIGHT_BITS] = { nullptr }; // CS_P2 each, bit z of [y * CS_P + x] is bit b of the light level of the voxel
+};
+
+int getLightLevel(const LightVolume& volume, int x, int y, int z);
+void setLightLevel(LightVolume& volume, int x, int y, int z, int level);
+
+// Lights a chunk from scratch. Light passes through the voxels that are not in opaqueMask, sources can be
+// opaque (glowing blocks). Light and sky light are separate volumes that are propagated the same way.
+//
+// @param[in] sources: Emitted light of every voxel. The padding holds the light of the neighbouring chunks.
+// @param[out] light: Overwritten, the padding is copied from sources.
+void propagateLight(const uint64_t* opaqueMask, const LightVolume& sources, LightVolume& light);
+
+// Relights the voxels around the voxel at x, y, z (padded, 1-62) after it was edited in opaqueMask or
+// sources. Light changes at most MAX_LIGHT_LEVEL - 1 voxels away, so only that box is propagated again.
+void updateLight(const uint64_t* opaqueMask, const LightVolume& sources, LightVolume& light, int x, int y, int z);
+
+// Sets the sky light sources of a chunk: MAX_LIGHT_LEVEL for every voxel with only air between it and the
+// top of the chunk where the sky comes in, 0 for all other voxels.
+//
+// @param[in] skyAbove: CS_P words indexed by x, bit z is set where sky light enters the top layer of the chunk.
+// nullptr if the chunk is open to the sky.
+// @param[out] skyBelow: CS_P words like skyAbove for the chunk below, optional.
+void buildSkyLightSources(const uint64_t* opaqueMask, const uint64_t* skyAbove, LightVolume& sources, uint64_t* skyBelow = nullptr);
+
+// Same as updateLight() for sky light. The sky light sources of the edited column are rebuilt first, and
+// since they reach down to the bottom of the chunk the box is extended down as well.
+void updateSkyLight(const uint64_t* opaqueMask, const uint64_t* skyAbove, LightVolume& sources, LightVolume& light, int x, int y, int z);
+
+// The brightest air voxel in front of a quad of a regular chunk (mesh() output) of face. Quads merge
+// over voxels with different light, so meshes that need exact light should mesh the light levels
+// as part of the voxel type.
+int getQuadLight(const LightVolume& light, uint64_t quad, int face);
+
+// Stores a light level in the spare bits of a quad of a regular chunk
+static inline uint64_t setQuadLight(uint64_t quad, int level) {
+  return (quad & ~((uint64_t) MAX_LIGHT_LEVEL << QUAD_LIGHT_SHIFT)) | ((uint64_t) level << QUAD_LIGHT_SHIFT);
+}
+
+#endif // LIGHTING_H
+
+#ifdef BM_IMPLEMENTATION
+#ifndef LIGHTING_IMPLEMENTATION_H
+#define LIGHTING_IMPLEMENTATION_H
+
+// Bits of a column whose light is at least level, a bit-sliced compare against a constant
+static inline uint64_t getLightAtLeast(const LightVolume& volume, const int i, const int level) {
+  uint64_t greater = 0;
+  uint64_t equal = ~0ull;
+  for (int b = LIGHT_BITS - 1; b >= 0; b--) {
+    const uint64_t plane = volume.planes[b][i];
+    const uint64_t levelBit = 0 - (uint64_t) ((level >> b) & 1);
+    greater |= equal & plane & ~levelBit;
+    equal &= ~(plane ^ levelBit);
+  }
+  return greater | equal;
+}
+
+// Propagates the light of the bits in zMask of the columns x in [xBegin, xEnd), y in [yBegin, yEnd) (1-62),
+// reading the rest of the volume as it is.
+//
+// The sets of voxels with at least level k for k = MAX_LIGHT_LEVEL..1 are a thermometer code of the light
+// level, bit b of the level is the parity of the sets with k a multiple of 2^b.
+static void propagateLightRegion(const uint64_t* opaqueMask, const LightVolume& sources, LightVolume& light,
+  const int xBegin, const int xEnd, const int yBegin, const int yEnd, const uint64_t zMask) {
+  uint64_t levels[2][CS_P2];
+  // Columns with sources, and columns with light outside of the region that has to be read back
+  uint8_t hasSources[CS_P2];
+  uint8_t hasLight[CS_P2];
+
+  for (int y = yBegin - 1; y <= yEnd; y++) {
+    for (int x = xBegin - 1; x <= xEnd; x++) {
+      const int i = y * CS_P + x;
+      const bool inside = x >= xBegin && x < xEnd && y >= yBegin && y < yEnd;
+      const uint64_t outside = inside ? ~zMask : ~0ull;
+      uint64_t emitted = 0;
+      uint64_t lit = 0;
+      for (int b = 0; b < LIGHT_BITS; b++) {
+        emitted |= sources.planes[b][i];
+        lit |= light.planes[b][i] & outside;
+        if (inside) light.planes[b][i] &= ~zMask;
+      }
+      levels[0][i] = 0;
+      hasSources[i] = (emitted & zMask) != 0;
+      hasLight[i] = lit != 0;
+    }
+  }
+
+  int current = 0;
+  for (int level = MAX_LIGHT_LEVEL; level > 0; level--) {
+    const uint64_t* above = levels[current];
+    uint64_t* next = levels[current ^ 1];
+
+    for (int y = yBegin - 1; y <= yEnd; y++) {
+      for (int x = xBegin - 1; x <= xEnd; x++) {
+        const int i = y * CS_P + x;
+        const uint64_t stored = hasLight[i] ? getLightAtLeast(light, i, level) : 0;
+
+        if (x < xBegin || x >= xEnd || y < yBegin || y >= yEnd) {
+          next[i] = stored;
+          continue;
+        }
+
+        const uint64_t spread = above[i] | (above[i] << 1) | (above[i] >> 1) |
+          above[i - 1] | above[i + 1] | above[i - CS_P] | above[i + CS_P];
+        uint64_t lit = above[i] | (spread & ~opaqueMask[i]);
+        if (hasSources[i]) lit |= getLightAtLeast(sources, i, level);
+        lit &= zMask;
+        next[i] = lit | (stored & ~zMask);
+
+        // Bit b of the level flips with every set whose level is a multiple of 2^b
+        for (int b = 0; b < LIGHT_BITS; b++) {
+          if (!(level & ((1 << b) - 1))) light.planes[b][i] ^= lit;
+        }
+      }
+    }
+
+    current ^= 1;
+  }
+}
+
+int getLightLevel(const LightVolume& volume, int x, int y, int z) {
+  int level = 0;
+  for (int b = 0; b < LIGHT_BITS; b++) {
+    level |= (int) ((volume.planes[b][y * CS_P + x] >> z) & 1) << b;
+  }
+  return level;
+}
+
+void setLightLevel(LightVolume& volume, int x, int y, int z, int level) {
+  for (int b = 0; b < LIGHT_BITS; b++) {
+    uint64_t& column = volume.planes[b][y * CS_P + x];
+    column = (column & ~(1ull << z)) | ((uint64_t) ((level >> b) & 1) << z);
+  }
+}
+
+void propagateLight(const uint64_t* opaqueMask, const LightVolume& sources, LightVolume& light) {
+  for (int b = 0; b < LIGHT_BITS; b++) {
+    for (int i = 0; i < CS_P2; i++) {
+      light.planes[b][i] = sources.planes[b][i];
+    }
+  }
+  propagateLightRegion(opaqueMask, sources, light, 1, CS_P - 1, 1, CS_P - 1, P_MASK);
+}
+
+// Box of MAX_LIGHT_LEVEL - 1 voxels around x, y, z clipped to the inner voxels, y from yBegin
+static inline void updateLightBox(const uint64_t* opaqueMask, const LightVolume& sources, LightVolume& light, int x, int yBegin, int y, int z) {
+  static constexpr int reach = MAX_LIGHT_LEVEL - 1;
+  const int xBegin = x - reach > 1 ? x - reach : 1;
+  const int xEnd = x + reach + 1 < CS_P - 1 ? x + reach + 1 : CS_P - 1;
+  const int yEnd = y + reach + 1 < CS_P - 1 ? y + reach + 1 : CS_P - 1;
+  const int zBegin = z - reach > 0 ? z - reach : 0;
+  const int zEnd = z + reach + 1 < CS_P ? z + reach + 1 : CS_P;
+  const uint64_t zMask = (~0ull >> (CS_P - zEnd)) & (~0ull << zBegin) & P_MASK;
+  propagateLightRegion(opaqueMask, sources, light, xBegin, xEnd, yBegin > 1 ? yBegin : 1, yEnd, zMask);
+}
+
+void updateLight(const uint64_t* opaqueMask, const LightVolume& sources, LightVolume& light, int x, int y, int z) {
+  updateLightBox(opaqueMask, sources, light, x, y - (MAX_LIGHT_LEVEL - 1), y, z);
+}
+
+// Sky light sources of the column at x, from the top layer down
+static inline uint64_t buildSkyLightColumn(const uint64_t* opaqueMask, const uint64_t* skyAbove, LightVolume& sources, const int x) {
+  uint64_t sky = skyAbove ? skyAbove[x] : ~0ull;
+  for (int y = CS_P - 1; y >= 0; y--) {
+    const int i = y * CS_P + x;
+    sky &= ~opaqueMask[i];
+    for (int b = 0; b < LIGHT_BITS; b++) {
+      sources.planes[b][i] = sky;
+    }
+  }
+  return sky;
+}
+
+void buildSkyLightSources(const uint64_t* opaqueMask, const uint64_t* skyAbove, LightVolume& sources, uint64_t* skyBelow) {
+  for (int x = 0; x < CS_P; x++) {
+    const uint64_t sky = buildSkyLightColumn(opaqueMask, skyAbove, sources, x);
+    if (skyBelow) skyBelow[x] = sky;
+  }
+}
+
+void updateSkyLight(const uint64_t* opaqueMask, const uint64_t* skyAbove, LightVolume& sources, LightVolume& light, int x, int y, int z) {
+  buildSkyLightColumn(opaqueMask, skyAbove, sources, x);
+
+  // The padding of the column changed with the sources
+  for (int i = 0; i < CS_P; i++) {
+    const uint64_t padding = (i == 0 || i == CS_P - 1) ? ~0ull : ~P_MASK;
+    for (int b = 0; b < LIGHT_BITS; b++) {
+      uint64_t& column = light.planes[b][i * CS_P + x];
+      column = (column & ~padding) | (sources.planes[b][i * CS_P + x] & padding);
+    }
+  }
+  updateLightBox(opaqueMask, sources, light, x, 1, y, z);
+}
+
+int getQuadLight(const LightVolume& light, uint64_t quad, int face) {
+  const int q[3] = { (int) (quad & 63), (int) ((quad >> 6) & 63), (int) ((quad >> 12) & 63) };
+  const int w = (int) ((quad >> 18) & 63);
+  const int h = (int) ((quad >> 24) & 63);
+
+  // Padded inclusive box of the air voxels in front of the quad, see mergeFaces() for the quad axes
+  const int axis = face < 2 ? 1 : face < 4 ? 0 : 2;
+  const int widthAxis = face < 2 ? 0 : face < 4 ? 1 : 0;
+  const int heightAxis = face < 4 ? 2 : 1;
+  const bool reversed = face == 1 || face == 2 || face == 4;
+  int min[3];
+  int max[3];
+  min[axis] = max[axis] = q[axis] + (~face & 1);
+  min[widthAxis] = q[widthAxis] + 1 - (reversed ? w : 0);
+  max[widthAxis] = min[widthAxis] + w - 1;
+  min[heightAxis] = q[heightAxis] + 1;
+  max[heightAxis] = min[heightAxis] + h - 1;
+  const uint64_t zMask = (~0ull >> (63 - max[2])) & (~0ull << min[2]);
+
+  // Finds the highest level bit by bit, keeping the bits found so far
+  int level = 0;
+  for (int b = LIGHT_BITS - 1; b >= 0; b--) {
+    const int candidate = level | (1 << b);
+    bool found = false;
+    for (int y = min[1]; y <= max[1] && !found; y++) {
+      for (int x = min[0]; x <= max[0] && !found; x++) {
+        found = (getLightAtLeast(light, y * CS_P + x, candidate) & zMask) != 0;
+      }
+    }
+    if (found) level = candidate;
+  }
+  return level;
+}
+
+#endif // LIGHTING_IMPLEMENTATION_H
+#endif // BM_IMPLEMENTATION
@@ -0,0 +1,172 @@
+#ifndef NAVIGATION_H
+#define NAVIGATION_H
+
+//   Walkable cells and their step connectivity for pathfinding, extracted from the occupancy mask of the
+//   mesher (MeshData::opaqueMask) 64 cells at a time.
+//
+//   Columns of opaqueMask run along z while up is y, so "solid below and air above" is an AND of the column
+//   words of neighbouring layers rather than a shift within a column.
+
+#include "../mesher.h"
+
+// Horizontal directions of NavGrid::links, in the same order as the faces of the mesher
+enum NavDirection {
+  NAV_POSITIVE_X,
+  NAV_NEGATIVE_X,
+  NAV_POSITIVE_Z,
+  NAV_NEGATIVE_Z,
+};
+
+// Cells are in the padded coordinates of opaqueMask, so cells and links in the padding lead into the neighbouring
+// chunks. Layers above the padding are unknown and count as air.
+struct NavGrid {
+  int clearance = 2; // Air voxels that a walkable cell needs above the floor, including itself
+  int stepHeight = 1; // Highest step up or down between neighbouring cells, less than clearance
+  uint64_t* walkable = nullptr; // CS_P2, bit z of [y * CS_P + x] marks an air voxel with clearance air above a solid voxel
+  uint64_t* links[4] = { nullptr }; // CS_P2 each, marks walkable cells that can move to a walkable cell in the NavDirection
+};
+
+// @param[out] nav: walkable and links are overwritten.
+void buildNavGrid(const uint64_t* opaqueMask, NavGrid& nav);
+
+// Updates the cells and links that depend on the column at x, y (0-63) after it has been edited,
+// see updateOpaqueMaskColumn().
+void updateNavGrid(const uint64_t* opaqueMask, NavGrid& nav, int x, int y);
+
+// Finds the walkable cell that a linked cell moves to in a direction. Two walkable cells of the neighbouring
+// column can be within stepHeight, but the floor of the upper one blocks the air needed to step down to the
+// lower one, so only one of them can be reached.
+//
+// @param[in] opaqueMask: The mask that nav was built from, for the air above the cells.
+// @param[out] neighbour: x, y, z of the cell.
+// @return false if the cell isn't linked in the direction.
+bool getNavNeighbour(const uint64_t* opaqueMask, const NavGrid& nav, int x, int y, int z, int direction, int* neighbour);
+
+#endif // NAVIGATION_H
+
+#ifdef BM_IMPLEMENTATION
+#ifndef NAVIGATION_IMPLEMENTATION_H
+#define NAVIGATION_IMPLEMENTATION_H
+
+// Air bits of the column at x, y. Layers above the chunk are unknown and count as air.
+static inline uint64_t getNavAir(const uint64_t* opaqueMask, const int x, const int y) {
+  return y < CS_P ? ~opaqueMask[y * CS_P + x] : ~0ull;
+}
+
+// Column of a neighbouring cell in a direction, shifted so that the bits line up with the cell
+static inline uint64_t getNavColumn(const uint64_t* columns, const int x, const int y, const int direction) {
+  switch (direction) {
+    case NAV_POSITIVE_X: return x + 1 < CS_P ? columns[y * CS_P + x + 1] : 0;
+    case NAV_NEGATIVE_X: return x > 0 ? columns[y * CS_P + x - 1] : 0;
+    case NAV_POSITIVE_Z: return columns[y * CS_P + x] >> 1;
+    default: return columns[y * CS_P + x] << 1;
+  }
+}
+
+// Same as getNavColumn() for the air of the neighbouring column
+static inline uint64_t getNavNeighbourAir(const uint64_t* opaqueMask, const int x, const int y, const int direction) {
+  if (y >= CS_P) return ~0ull;
+  if ((direction == NAV_POSITIVE_X && x + 1 >= CS_P) || (direction == NAV_NEGATIVE_X && x == 0)) return 0;
+  return ~getNavColumn(opaqueMask, x, y, direction);
+}
+
+static inline void buildNavCell(const uint64_t* opaqueMask, NavGrid& nav, const int x, const int y) {
+  uint64_t walkable = 0;
+  if (y > 0) {
+    walkable = opaqueMask[(y - 1) * CS_P + x];
+    for (int i = 0; i < nav.clearance; i++) {
+      walkable &= getNavAir(opaqueMask, x, y + i);
+    }
+  }
+  nav.walkable[y * CS_P + x] = walkable;
+}
+
+// Cells of layer y whose neighbour in a direction, step layers up or down, is walkable and can be reached
+static inline uint64_t getNavStep(const uint64_t* opaqueMask, const NavGrid& nav, const int x, const int y, const int step, const int direction) {
+  const int targetY = y + step;
+  if (targetY < 1 || targetY >= CS_P) return 0;
+
+  uint64_t target = getNavColumn(nav.walkable, x, targetY, direction);
+
+  // Stepping up needs air above the head of the cell, stepping down needs air above
+  // the head of the target cell
+  for (int j = 0; j < step; j++) {
+    target &= getNavAir(opaqueMask, x, y + nav.clearance + j);
+  }
+  for (int j = step; j < 0; j++) {
+    target &= getNavNeighbourAir(opaqueMask, x, y + nav.clearance + j, direction);
+  }
+  return target;
+}
+
+static inline void buildNavLinks(const uint64_t* opaqueMask, NavGrid& nav, const int x, const int y) {
+  const int i = y * CS_P + x;
+  const uint64_t walkable = nav.walkable[i];
+
+  for (int direction = 0; direction < 4; direction++) {
+    uint64_t linked = 0;
+    if (walkable) {
+      for (int step = -nav.stepHeight; step <= nav.stepHeight; step++) {
+        linked |= getNavStep(opaqueMask, nav, x, y, step, direction);
+      }
+    }
+    nav.links[direction][i] = walkable & linked;
+  }
+}
+
+void buildNavGrid(const uint64_t* opaqueMask, NavGrid& nav) {
+  for (int y = 0; y < CS_P; y++) {
+    for (int x = 0; x < CS_P; x++) {
+      buildNavCell(opaqueMask, nav, x, y);
+    }
+  }
+
+  for (int y = 0; y < CS_P; y++) {
+    for (int x = 0; x < CS_P; x++) {
+      buildNavLinks(opaqueMask, nav, x, y);
+    }
+  }
+}
+
+void updateNavGrid(const uint64_t* opaqueMask, NavGrid& nav, int x, int y) {
+  // The column is the floor of the layer above and part of the clearance of the layers below
+  const int cellBegin = y - nav.clearance + 1 > 0 ? y - nav.clearance + 1 : 0;
+  const int cellEnd = y + 2 < CS_P ? y + 2 : CS_P;
+  for (int i = cellBegin; i < cellEnd; i++) {
+    buildNavCell(opaqueMask, nav, x, i);
+  }
+
+  // Links reach stepHeight layers up and down, and check the air up to stepHeight above the clearance
+  const int reach = nav.clearance + nav.stepHeight;
+  const int linkBegin = y - reach > 0 ? y - reach : 0;
+  const int linkEnd = y + nav.stepHeight + 2 < CS_P ? y + nav.stepHeight + 2 : CS_P;
+  const int xBegin = x > 0 ? x - 1 : 0;
+  const int xEnd = x + 2 < CS_P ? x + 2 : CS_P;
+  for (int i = linkBegin; i < linkEnd; i++) {
+    for (int j = xBegin; j < xEnd; j++) {
+      buildNavLinks(opaqueMask, nav, j, i);
+    }
+  }
+}
+
+bool getNavNeighbour(const uint64_t* opaqueMask, const NavGrid& nav, int x, int y, int z, int direction, int* neighbour) {
+  if (!((nav.links[direction][y * CS_P + x] >> z) & 1)) return false;
+
+  static constexpr int offsets[4][2] = { { 1, 0 }, { -1, 0 }, { 0, 1 }, { 0, -1 } };
+  const int targetX = x + offsets[direction][0];
+  const int targetZ = z + offsets[direction][1];
+
+  // The walkable cells in reach are only the ones with enough air to step to them
+  for (int step = -nav.stepHeight; step <= nav.stepHeight; step++) {
+    if ((getNavStep(opaqueMask, nav, x, y, step, direction) >> z) & 1) {
+      neighbour[0] = targetX;
+      neighbour[1] = y + step;
+      neighbour[2] = targetZ;
+      return true;
+    }
+  }
+  return false;
+}
+
+#endif // NAVIGATION_IMPLEMENTATION_H
+#endif // BM_IMPLEMENTATION
@@ -0,0 +1,325 @@
+#ifndef OCCUPANCY_H
+#define OCCUPANCY_H
+
+//   Occupancy mips of chunks and a world grid of occupied chunks, for ray queries that skip empty space
+//   hierarchically instead of voxel by voxel.
+
+#include "../physics/raycast.h"
+
+// Occupancy of a chunk at coarser resolutions, built from its opaqueMask by OR-reduction. The cells are aligned
+// to the padded coordinates of opaqueMask and only the inner voxels of the chunk count.
+struct OccupancyMips {
+  uint64_t level8[8] = { 0 }; // 8^3 cells of 8^3 voxels, bit x * 8 + z of word y
+  uint64_t level4 = 0; // 4^3 cells of 16^3 voxels, bit (y * 4 + x) * 4 + z
+  uint8_t level2 = 0; // 2^3 cells of 32^3 voxels, bit (y * 2 + x) * 2 + z
+  bool occupied = false; // Any voxel
+};
+
+void buildOccupancyMips(const uint64_t* opaqueMask, OccupancyMips& mips);
+
+// Rebuilds the cells above the column at x, y (0-63) after it has been edited, see updateOpaqueMaskColumn().
+void updateOccupancyMips(const uint64_t* opaqueMask, OccupancyMips& mips, int x, int y);
+
+// One bit per chunk for a box of chunks in the world, set for chunks that contain any voxel
+// (OccupancyMips::occupied). Lets ray queries skip empty and unloaded chunks without looking them up.
+struct OccupancyGrid {
+  int origin[3] = { 0 }; // First chunk
+  int size[3] = { 0 }; // In chunks
+  BM_VECTOR<uint64_t> bits;
+
+  void init(const int* origin, const int* size);
+  void set(int x, int y, int z, bool occupied);
+  bool get(int x, int y, int z) const; // false outside of the grid
+};
+
+struct OccupancyChunk {
+  const uint64_t* opaqueMask = nullptr;
+  const OccupancyMips* mips = nullptr; // Optional, chunks without mips are traced voxel by voxel
+};
+
+// Casts a ray through the chunks of the grid. Empty chunks are skipped with the grid, and inside of chunks
+// the ray skips empty 32^3, 16^3 and 8^3 cells with the mips. Only 8^3 cells that contain voxels are traced
+// with raycastChunk().
+//
+// @param[in] getChunk: Called as getChunk(chunkX, chunkY, chunkZ) for the occupied chunks along the ray.
+// Returns the OccupancyChunk of the chunk, with a null opaqueMask for chunks that aren't loaded.
+// @return Whether the ray hit a voxel within ray.maxDistance.
+template <typename GetChunk>
+bool raycastOccupancy(const OccupancyGrid& grid, GetChunk getChunk, const Ray& ray, RayHit& hit);
+
+// Clips a ray with a normalized direction to the chunks of the grid, returns false if it misses them
+bool clipRayToGrid(const OccupancyGrid& grid, const float* origin, const float* direction, float maxDistance, float& tStart, float& tEnd);
+
+// traceChunk() that skips the empty cells of the mips
+bool traceOccupancyChunk(const OccupancyChunk& chunk, const float* origin, const float* direction, float maxDistance, RayHit& hit);
+
+template <typename GetChunk>
+bool raycastOccupancy(const OccupancyGrid& grid, GetChunk getChunk, const Ray& ray, RayHit& hit) {
+  hit = RayHit();
+
+  float direction[3];
+  if (!getRayDirection(ray, direction)) return false;
+
+  float tStart, tEnd;
+  if (!clipRayToGrid(grid, ray.origin, direction, ray.maxDistance, tStart, tEnd)) return false;
+
+  RayChunkWalk walk;
+  walk.init(ray.origin, direction, tStart);
+
+  while (walk.t <= tEnd) {
+    if (grid.get(walk.chunk[0], walk.chunk[1], walk.chunk[2])) {
+      const OccupancyChunk chunk = getChunk(walk.chunk[0], walk.chunk[1], walk.chunk[2]);
+      if (chunk.opaqueMask) {
+        float origin[3];
+        for (int axis = 0; axis < 3; axis++) {
+          origin[axis] = ray.origin[axis] - walk.chunk[axis] * CS + 1;
+        }
+
+        if (traceOccupancyChunk(chunk, origin, direction, ray.maxDistance, hit)) {
+          for (int axis = 0; axis < 3; axis++) {
+            hit.voxel[axis] += walk.chunk[axis] * CS - 1;
+          }
+          return true;
+        }
+      }
+    }
+    walk.next();
+  }
+
+  return false;
+}
+
+#endif // OCCUPANCY_H
+
+#ifdef BM_IMPLEMENTATION
+#ifndef OCCUPANCY_IMPLEMENTATION_H
+#define OCCUPANCY_IMPLEMENTATION_H
+
+#include <math.h> // floorf
+#include <float.h> // FLT_MAX
+
+// Bit i of the result is set if byte i of bits is non-zero
+static inline uint8_t getNonZeroBytes(uint64_t bits) {
+  bits |= bits >> 4;
+  bits |= bits >> 2;
+  bits |= bits >> 1;
+  return (uint8_t) (((bits & 0x0101010101010101ull) * 0x0102040810204080ull) >> 56);
+}
+
+// The 8 z cells of the 8^3 cells at cellX, cellY
+static inline uint8_t getOccupancyCells(const uint64_t* opaqueMask, const int cellX, const int cellY) {
+  const int xBegin = cellX * 8 < 1 ? 1 : cellX * 8;
+  const int xEnd = cellX * 8 + 8 > CS_P - 1 ? CS_P - 1 : cellX * 8 + 8;
+  const int yBegin = cellY * 8 < 1 ? 1 : cellY * 8;
+  const int yEnd = cellY * 8 + 8 > CS_P - 1 ? CS_P - 1 : cellY * 8 + 8;
+
+  uint64_t bits = 0;
+  for (int y = yBegin; y < yEnd; y++) {
+    for (int x = xBegin; x < xEnd; x++) {
+      bits |= opaqueMask[y * CS_P + x];
+    }
+  }
+
+  return getNonZeroBytes(bits & P_MASK);
+}
+
+// Reduces level8 into the coarser levels
+static inline void buildUpperOccupancyMips(OccupancyMips& mips) {
+  mips.level4 = 0;
+  for (int y = 0; y < 4; y++) {
+    const uint64_t rows = mips.level8[y * 2] | mips.level8[y * 2 + 1];
+    for (int x = 0; x < 4; x++) {
+      const uint8_t cells = (uint8_t) (rows >> (x * 16)) | (uint8_t) (rows >> (x * 16 + 8));
+      for (int z = 0; z < 4; z++) {
+        if ((cells >> (z * 2)) & 3) mips.level4 |= 1ull << ((y * 4 + x) * 4 + z);
+      }
+    }
+  }
+
+  mips.level2 = 0;
+  for (int y = 0; y < 2; y++) {
+    for (int x = 0; x < 2; x++) {
+      uint8_t cells = 0;
+      for (int i = 0; i < 4; i++) {
+        const int y4 = y * 2 + (i >> 1);
+        const int x4 = x * 2 + (i & 1);
+        cells |= (uint8_t) (mips.level4 >> ((y4 * 4 + x4) * 4)) & 15;
+      }
+      for (int z = 0; z < 2; z++) {
+        if ((cells >> (z * 2)) & 3) mips.level2 |= 1 << ((y * 2 + x) * 2 + z);
+      }
+    }
+  }
+
+  mips.occupied = mips.level2 != 0;
+}
+
+void buildOccupancyMips(const uint64_t* opaqueMask, OccupancyMips& mips) {
+  for (int cellY = 0; cellY < 8; cellY++) {
+    uint64_t cells = 0;
+    for (int cellX = 0; cellX < 8; cellX++) {
+      cells |= (uint64_t) getOccupancyCells(opaqueMask, cellX, cellY) << (cellX * 8);
+    }
+    mips.level8[cellY] = cells;
+  }
+
+  buildUpperOccupancyMips(mips);
+}
+
+void updateOccupancyMips(const uint64_t* opaqueMask, OccupancyMips& mips, int x, int y) {
+  const int cellX = x >> 3;
+  const int cellY = y >> 3;
+
+  uint64_t& cells = mips.level8[cellY];
+  cells &= ~(0xFFull << (cellX * 8));
+  cells |= (uint64_t) getOccupancyCells(opaqueMask, cellX, cellY) << (cellX * 8);
+
+  buildUpperOccupancyMips(mips);
+}
+
+void OccupancyGrid::init(const int* gridOrigin, const int* gridSize) {
+  for (int axis = 0; axis < 3; axis++) {
+    origin[axis] = gridOrigin[axis];
+    size[axis] = gridSize[axis];
+  }
+  bits.assign((size[0] * size[1] * size[2] + 63) / 64, 0);
+}
+
+void OccupancyGrid::set(int x, int y, int z, bool occupied) {
+  x -= origin[0];
+  y -= origin[1];
+  z -= origin[2];
+  if (x < 0 || y < 0 || z < 0 || x >= size[0] || y >= size[1] || z >= size[2]) return;
+
+  const int i = (y * size[0] + x) * size[2] + z;
+  if (occupied) bits[i >> 6] |= 1ull << (i & 63);
+  else bits[i >> 6] &= ~(1ull << (i & 63));
+}
+
+bool OccupancyGrid::get(int x, int y, int z) const {
+  x -= origin[0];
+  y -= origin[1];
+  z -= origin[2];
+  if (x < 0 || y < 0 || z < 0 || x >= size[0] || y >= size[1] || z >= size[2]) return false;
+
+  const int i = (y * size[0] + x) * size[2] + z;
+  return (bits[i >> 6] >> (i & 63)) & 1;
+}
+
+bool clipRayToGrid(const OccupancyGrid& grid, const float* origin, const float* direction, float maxDistance, float& tStart, float& tEnd) {
+  tStart = 0;
+  tEnd = maxDistance;
+  for (int axis = 0; axis < 3; axis++) {
+    const float boxMin = (float) grid.origin[axis] * CS;
+    const float boxMax = (float) (grid.origin[axis] + grid.size[axis]) * CS;
+    if (direction[axis] == 0) {
+      if (origin[axis] < boxMin || origin[axis] >= boxMax) return false;
+      continue;
+    }
+
+    const float tMin = (boxMin - origin[axis]) / direction[axis];
+    const float tMax = (boxMax - origin[axis]) / direction[axis];
+    const float tNear = direction[axis] > 0 ? tMin : tMax;
+    const float tFar = direction[axis] > 0 ? tMax : tMin;
+    if (tNear > tStart) tStart = tNear;
+    if (tFar < tEnd) tEnd = tFar;
+  }
+  return tStart <= tEnd;
+}
+
+// Whether the cell of the given size (8, 16 or 32) that contains voxel holds any voxels
+static inline bool getOccupancyCell(const OccupancyMips& mips, const int size, const int* voxel) {
+  const int x = voxel[0];
+  const int y = voxel[1];
+  const int z = voxel[2];
+  switch (size) {
+    case 32: return (mips.level2 >> (((y >> 5) * 2 + (x >> 5)) * 2 + (z >> 5))) & 1;
+    case 16: return (mips.level4 >> (((y >> 4) * 4 + (x >> 4)) * 4 + (z >> 4))) & 1;
+    default: return (mips.level8[y >> 3] >> ((x >> 3) * 8 + (z >> 3))) & 1;
+  }
+}
+
+bool traceOccupancyChunk(const OccupancyChunk& chunk, const float* origin, const float* direction, float maxDistance, RayHit& hit) {
+  if (!chunk.mips) return traceChunk(chunk.opaqueMask, origin, direction, maxDistance, hit);
+
+  const OccupancyMips& mips = *chunk.mips;
+  if (!mips.occupied) return false;
+
+  static constexpr int boxMin = 1;
+  static constexpr int boxMax = CS_P - 1;
+
+  // Clip the ray to the inner voxels
+  float t = 0;
+  float tEnd = maxDistance;
+  for (int axis = 0; axis < 3; axis++) {
+    if (direction[axis] == 0) {
+      if (origin[axis] < boxMin || origin[axis] >= boxMax) return false;
+      continue;
+    }
+
+    const float tMin = (boxMin - origin[axis]) / direction[axis];
+    const float tMax = (boxMax - origin[axis]) / direction[axis];
+    const float tNear = direction[axis] > 0 ? tMin : tMax;
+    const float tFar = direction[axis] > 0 ? tMax : tMin;
+    if (tNear > t) t = tNear;
+    if (tFar < tEnd) tEnd = tFar;
+  }
+  if (t >= tEnd) return false;
+
+  int voxel[3];
+  for (int axis = 0; axis < 3; axis++) {
+    const int v = (int) floorf(origin[axis] + direction[axis] * t);
+    voxel[axis] = v < boxMin ? boxMin : v >= boxMax ? boxMax - 1 : v;
+  }
+
+  while (true) {
+    // Find the largest empty cell that contains the voxel
+    int size = 32;
+    while (size >= 8 && getOccupancyCell(mips, size, voxel)) {
+      size >>= 1;
+    }
+    const int cellSize = size < 8 ? 8 : size;
+
+    int cellMin[3];
+    int cellMax[3];
+    for (int axis = 0; axis < 3; axis++) {
+      cellMin[axis] = voxel[axis] & ~(cellSize - 1);
+      cellMax[axis] = cellMin[axis] + cellSize;
+      if (cellMin[axis] < boxMin) cellMin[axis] = boxMin;
+      if (cellMax[axis] > boxMax) cellMax[axis] = boxMax;
+    }
+
+    // Trace the voxels of occupied 8^3 cells
+    if (size < 8 && traceBox(chunk.opaqueMask, origin, direction, maxDistance, cellMin, cellMax, hit)) {
+      return true;
+    }
+
+    // Move on to the cell that the ray enters next
+    int exitAxis = 0;
+    float tExit = FLT_MAX;
+    for (int axis = 0; axis < 3; axis++) {
+      if (direction[axis] == 0) continue;
+      const float tAxis = ((direction[axis] > 0 ? cellMax[axis] : cellMin[axis]) - origin[axis]) / direction[axis];
+      if (tAxis < tExit) {
+        tExit = tAxis;
+        exitAxis = axis;
+      }
+    }
+    if (tExit >= tEnd) return false;
+
+    t = tExit;
+    for (int axis = 0; axis < 3; axis++) {
+      if (axis == exitAxis) {
+        voxel[axis] = direction[axis] > 0 ? cellMax[axis] : cellMin[axis] - 1;
+      }
+      else {
+        const int v = (int) floorf(origin[axis] + direction[axis] * t);
+        voxel[axis] = v < cellMin[axis] ? cellMin[axis] : v >= cellMax[axis] ? cellMax[axis] - 1 : v;
+      }
+    }
+    if (voxel[exitAxis] < boxMin || voxel[exitAxis] >= boxMax) return false;
+  }
+}
+
+#endif // OCCUPANCY_IMPLEMENTATION_H
+#endif // BM_IMPLEMENTATION
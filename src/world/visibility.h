@@ -0,0 +1,108 @@
+#ifndef VISIBILITY_H
+#define VISIBILITY_H
+
+//   Face connectivity of chunks for cave culling: which faces of a chunk can see each other through the air
+//   inside it. A renderer can walk from the camera chunk through the faces that connect and skip every chunk
+//   it doesn't reach.
+
+#include "flood_fill.h"
+
+// All faces connected, for example of chunks that are empty or not loaded
+static constexpr uint16_t FACE_CONNECTIVITY_ALL = 0x7FFF;
+
+// Fills the air of the chunk (the complement of opaqueMask) from its border voxels. Every pair of faces
+// (mesher face order) that an air region touches is connected.
+//
+// @return 15 bits, one per pair of faces.
+uint16_t getFaceConnectivity(const uint64_t* opaqueMask);
+
+// Whether two different faces can see each other in a set returned by getFaceConnectivity()
+bool areFacesConnected(uint16_t connectivity, int faceA, int faceB);
+
+#endif // VISIBILITY_H
+
+#ifdef BM_IMPLEMENTATION
+#ifndef VISIBILITY_IMPLEMENTATION_H
+#define VISIBILITY_IMPLEMENTATION_H
+
+static inline int getFacePairBit(int faceA, int faceB) {
+  if (faceA > faceB) {
+    const int face = faceA;
+    faceA = faceB;
+    faceB = face;
+  }
+  return faceA * (11 - faceA) / 2 + faceB - faceA - 1;
+}
+
+// Border faces of the chunk that the bits of a column touch
+static inline uint8_t getBorderFaces(const int i, const uint64_t bits) {
+  const int x = i % CS_P;
+  const int y = i / CS_P;
+  uint8_t faces = 0;
+  if (y == CS_P - 2) faces |= 1 << 0;
+  if (y == 1) faces |= 1 << 1;
+  if (x == CS_P - 2) faces |= 1 << 2;
+  if (x == 1) faces |= 1 << 3;
+  if ((bits >> (CS_P - 2)) & 1) faces |= 1 << 4;
+  if ((bits >> 1) & 1) faces |= 1 << 5;
+  return faces;
+}
+
+uint16_t getFaceConnectivity(const uint64_t* opaqueMask) {
+  uint64_t air[CS_P2];
+  uint64_t solid = 0;
+  for (int i = 0; i < CS_P2; i++) {
+    air[i] = ~opaqueMask[i];
+    solid |= getFillableColumn(opaqueMask, i);
+  }
+  if (!solid) return FACE_CONNECTIVITY_ALL;
+
+  uint64_t filled[CS_P2] = { 0 };
+  int stack[CS_P2];
+  uint64_t pending[CS_P2] = { 0 };
+  uint16_t connectivity = 0;
+
+  // Only air that touches the border can connect faces
+  static constexpr uint64_t zBorder = (1ull << 1) | (1ull << (CS_P - 2));
+  for (int y = 1; y < CS_P - 1; y++) {
+    for (int x = 1; x < CS_P - 1; x++) {
+      const int i = y * CS_P + x;
+      const uint64_t border = (x == 1 || x == CS_P - 2 || y == 1 || y == CS_P - 2) ? ~0ull : zBorder;
+
+      while (true) {
+        const uint64_t fillable = getFillableColumn(air, i);
+        const uint64_t remaining = fillable & border & ~filled[i];
+        if (!remaining) break;
+
+        uint8_t faces = 0;
+        auto visit = [&](const int column, const uint64_t bits) {
+          faces |= getBorderFaces(column, bits);
+        };
+
+        const uint64_t grown = fillColumnRuns(fillable & ~filled[i], remaining & (~remaining + 1));
+        filled[i] |= grown;
+        visit(i, grown);
+
+        stack[0] = i;
+        pending[i] = grown;
+        fillRegion(air, filled, stack, 1, pending, visit);
+
+        for (int a = 0; a < 6; a++) {
+          for (int b = a + 1; b < 6; b++) {
+            if (((faces >> a) & 1) && ((faces >> b) & 1)) connectivity |= 1 << getFacePairBit(a, b);
+          }
+        }
+        if (connectivity == FACE_CONNECTIVITY_ALL) return connectivity;
+      }
+    }
+  }
+
+  return connectivity;
+}
+
+bool areFacesConnected(uint16_t connectivity, int faceA, int faceB) {
+  return (connectivity >> getFacePairBit(faceA, faceB)) & 1;
+}
+
+#endif // VISIBILITY_IMPLEMENTATION_H
+#endif // BM_IMPLEMENTATION
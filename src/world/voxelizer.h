@@ -0,0 +1,321 @@
+#ifndef VOXELIZER_H
+#define VOXELIZER_H
+
+//   Turns triangle meshes into chunks in the layout that mesh() and LevelFile::compressAndAddChunk() take:
+//   64^3 ZXY voxels including the padding, and their opaqueMask.
+//
+//   The surface pass clips every triangle against the columns that it covers and sets the range of z bits
+//   between its lowest and highest point in the column. The solid pass casts a ray up through the centre of
+//   every column: each triangle that the ray crosses toggles the bit of the first voxel above the crossing,
+//   and a prefix XOR of the column word turns the toggles into the voxels with an odd number of crossings
+//   below them, which are the voxels inside a closed mesh. Chunks don't share any state, so they are
+//   voxelized on as many threads as there are.
+
+#include "../mesher.h"
+
+struct VoxelizerMesh {
+  const float* positions = nullptr; // xyz per vertex in world voxel coordinates, voxel v spans v to v + 1
+  const uint32_t* indices = nullptr; // 3 per triangle
+  int triangleCount = 0;
+
+  const uint8_t* types = nullptr; // Type of the surface voxels per triangle, nullptr to use surfaceType
+  uint8_t surfaceType = 1;
+  uint8_t fillType = 1; // Type of the voxels inside the mesh, 0 to only voxelize the surface
+};
+
+// Inclusive range of the chunks whose padded voxels overlap the mesh
+void getVoxelizerChunkBounds(const VoxelizerMesh& mesh, int* minChunk, int* maxChunk);
+
+// Voxelizes the mesh into one chunk, padding included, so neighbouring chunks agree on their shared voxels.
+//
+// A triangle marks the voxels that it passes through, faces that lie exactly on a voxel boundary only
+// mark the voxels behind them through the solid pass. The solid pass assumes a closed mesh, open meshes
+// should use a fillType of 0. Every written type is treated as opaque, call buildOpaqueMask() afterwards
+// if some of them are not.
+//
+// @param[in] chunkPos: Chunk coordinates, the padded voxel 0 of the chunk is world voxel chunkPos * CS - 1.
+// @param[out] voxels: 64^3 ZXY, overwritten.
+// @param[out] opaqueMask: CS_P2, overwritten.
+// @return Whether any voxel was set.
+bool voxelizeChunk(const VoxelizerMesh& mesh, const int* chunkPos, uint8_t* voxels, uint64_t* opaqueMask);
+
+// Voxelizes chunkCount chunks with voxelizeChunk() on threadCount threads. The mesh is only read.
+void voxelizeChunks(const VoxelizerMesh& mesh, const int* chunkPositions, int chunkCount,
+  uint8_t* const* voxels, uint64_t* const* opaqueMasks, int threadCount);
+
+#endif // VOXELIZER_H
+
+#ifdef BM_IMPLEMENTATION
+#ifndef VOXELIZER_IMPLEMENTATION_H
+#define VOXELIZER_IMPLEMENTATION_H
+
+#include <math.h> // floor, ceil
+#include <atomic>
+#include <thread>
+
+// Triangles that only touch a voxel within this distance of its sides don't mark it
+static constexpr double VOXELIZER_EPSILON = 1e-4;
+
+// Triangle vertices relative to the padded voxel 0 of a chunk
+struct VoxelizerTriangle {
+  double x[3], y[3], z[3];
+  double min[3], max[3];
+};
+
+static inline void getVoxelizerTriangle(const VoxelizerMesh& mesh, const int triangle, const int* origin, VoxelizerTriangle& t) {
+  for (int i = 0; i < 3; i++) {
+    const float* position = mesh.positions + mesh.indices[triangle * 3 + i] * 3;
+    t.x[i] = (double) position[0] - origin[0];
+    t.y[i] = (double) position[1] - origin[1];
+    t.z[i] = (double) position[2] - origin[2];
+  }
+  const double* axes[3] = { t.x, t.y, t.z };
+  for (int axis = 0; axis < 3; axis++) {
+    const double* v = axes[axis];
+    t.min[axis] = v[0] < v[1] ? (v[0] < v[2] ? v[0] : v[2]) : (v[1] < v[2] ? v[1] : v[2]);
+    t.max[axis] = v[0] > v[1] ? (v[0] > v[2] ? v[0] : v[2]) : (v[1] > v[2] ? v[1] : v[2]);
+  }
+}
+
+// Columns (or voxels) whose inside overlaps min to max along one axis, clamped to the chunk
+static inline void getVoxelizerRange(const double min, const double max, int& begin, int& end) {
+  begin = (int) floor(min + VOXELIZER_EPSILON);
+  end = (int) ceil(max - VOXELIZER_EPSILON) - 1;
+  begin = begin > 0 ? begin : 0;
+  end = end < CS_P - 1 ? end : CS_P - 1;
+}
+
+// Clips a polygon of xyz points to the side of the plane point[axis] = value given by sign
+static inline int clipPolygon(const double* in, const int count, double* out, const int axis, const double value, const double sign) {
+  int outCount = 0;
+  for (int i = 0; i < count; i++) {
+    const double* a = in + i * 3;
+    const double* b = in + ((i + 1) % count) * 3;
+    const double da = (a[axis] - value) * sign;
+    const double db = (b[axis] - value) * sign;
+
+    if (da >= 0) {
+      for (int j = 0; j < 3; j++) out[outCount * 3 + j] = a[j];
+      outCount++;
+    }
+    if ((da >= 0) != (db >= 0)) {
+      const double t = da / (da - db);
+      for (int j = 0; j < 3; j++) out[outCount * 3 + j] = a[j] + (b[j] - a[j]) * t;
+      outCount++;
+    }
+  }
+  return outCount;
+}
+
+// Surface pass: the z bits of column x, y that the triangle passes through
+static inline uint64_t getSurfaceBits(const VoxelizerTriangle& t, const int x, const int y) {
+  // A triangle clipped by 4 planes has at most 7 corners
+  double polygon[2][7 * 3];
+  for (int i = 0; i < 3; i++) {
+    polygon[0][i * 3 + 0] = t.x[i];
+    polygon[0][i * 3 + 1] = t.y[i];
+    polygon[0][i * 3 + 2] = t.z[i];
+  }
+
+  int count = 3;
+  count = clipPolygon(polygon[0], count, polygon[1], 0, x + VOXELIZER_EPSILON, 1);
+  count = clipPolygon(polygon[1], count, polygon[0], 0, x + 1 - VOXELIZER_EPSILON, -1);
+  count = clipPolygon(polygon[0], count, polygon[1], 1, y + VOXELIZER_EPSILON, 1);
+  count = clipPolygon(polygon[1], count, polygon[0], 1, y + 1 - VOXELIZER_EPSILON, -1);
+  if (!count) return 0;
+
+  double minZ = polygon[0][2];
+  double maxZ = polygon[0][2];
+  for (int i = 1; i < count; i++) {
+    const double z = polygon[0][i * 3 + 2];
+    minZ = z < minZ ? z : minZ;
+    maxZ = z > maxZ ? z : maxZ;
+  }
+
+  int begin, end;
+  getVoxelizerRange(minZ, maxZ, begin, end);
+  if (begin > end) return 0;
+  return (~0ull >> (CS_P - 1 - end)) & (~0ull << begin);
+}
+
+// Edge function of the edge from a to b at p, computed the same way for both directions of an edge so that
+// the triangles on either side of it see exactly opposite values
+static inline double getEdgeFunction(double ax, double ay, double bx, double by, const double px, const double py, bool& owned) {
+  const bool flip = ax > bx || (ax == bx && ay > by);
+  if (flip) {
+    double swap = ax; ax = bx; bx = swap;
+    swap = ay; ay = by; by = swap;
+  }
+
+  const double w = (bx - ax) * (py - ay) - (by - ay) * (px - ax);
+
+  // A point on the edge belongs to one of the two directions of the edge
+  owned = (by > ay) != flip;
+  return flip ? -w : w;
+}
+
+// Solid pass: the toggle bit of the crossing of the ray up through the centre of column x, y, if it crosses
+static inline uint64_t getCrossingBit(const VoxelizerTriangle& t, const int x, const int y) {
+  const double px = x + 0.5;
+  const double py = y + 0.5;
+
+  // Counter clockwise in xy
+  int b = 1;
+  int c = 2;
+  const double area = (t.x[1] - t.x[0]) * (t.y[2] - t.y[0]) - (t.y[1] - t.y[0]) * (t.x[2] - t.x[0]);
+  if (area == 0) return 0;
+  if (area < 0) {
+    b = 2;
+    c = 1;
+  }
+
+  const int corners[3] = { 0, b, c };
+  double weights[3];
+  for (int i = 0; i < 3; i++) {
+    const int from = corners[(i + 1) % 3];
+    const int to = corners[(i + 2) % 3];
+    bool owned;
+    weights[i] = getEdgeFunction(t.x[from], t.y[from], t.x[to], t.y[to], px, py, owned);
+    if (weights[i] < 0 || (weights[i] == 0 && !owned)) return 0;
+  }
+
+  const double z = (weights[0] * t.z[0] + weights[1] * t.z[b] + weights[2] * t.z[c]) /
+    (weights[0] + weights[1] + weights[2]);
+
+  // First voxel whose centre is above the crossing, crossings below the chunk flip every voxel
+  const double voxel = floor(z - 0.5) + 1;
+  if (voxel >= CS_P) return 0;
+  return voxel <= 0 ? 1 : 1ull << (int) voxel;
+}
+
+void getVoxelizerChunkBounds(const VoxelizerMesh& mesh, int* minChunk, int* maxChunk) {
+  for (int axis = 0; axis < 3; axis++) {
+    minChunk[axis] = 0;
+    maxChunk[axis] = -1;
+  }
+  if (!mesh.triangleCount) return;
+
+  const int origin[3] = { 0, 0, 0 };
+  double min[3], max[3];
+  for (int i = 0; i < mesh.triangleCount; i++) {
+    VoxelizerTriangle t;
+    getVoxelizerTriangle(mesh, i, origin, t);
+    for (int axis = 0; axis < 3; axis++) {
+      min[axis] = !i || t.min[axis] < min[axis] ? t.min[axis] : min[axis];
+      max[axis] = !i || t.max[axis] > max[axis] ? t.max[axis] : max[axis];
+    }
+  }
+
+  // The padded voxels of chunk c are c * CS - 1 to c * CS + CS
+  for (int axis = 0; axis < 3; axis++) {
+    minChunk[axis] = (int) ceil((floor(min[axis]) - CS) / CS);
+    maxChunk[axis] = (int) floor((floor(max[axis]) + 1) / CS);
+  }
+}
+
+bool voxelizeChunk(const VoxelizerMesh& mesh, const int* chunkPos, uint8_t* voxels, uint64_t* opaqueMask) {
+  BM_MEMSET(voxels, 0, CS_P3);
+  BM_MEMSET(opaqueMask, 0, CS_P2 * sizeof(uint64_t));
+
+  const int origin[3] = { chunkPos[0] * CS - 1, chunkPos[1] * CS - 1, chunkPos[2] * CS - 1 };
+  uint64_t toggles[CS_P2] = { 0 };
+  bool hasToggles = false;
+
+  for (int i = 0; i < mesh.triangleCount; i++) {
+    VoxelizerTriangle t;
+    getVoxelizerTriangle(mesh, i, origin, t);
+    if (t.max[0] < 0 || t.max[1] < 0 || t.min[0] > CS_P || t.min[1] > CS_P || t.min[2] > CS_P) continue;
+
+    int xBegin, xEnd, yBegin, yEnd;
+    getVoxelizerRange(t.min[0], t.max[0], xBegin, xEnd);
+    getVoxelizerRange(t.min[1], t.max[1], yBegin, yEnd);
+
+    // Triangles below the chunk still count for the solid pass
+    if (t.max[2] >= 0) {
+      const uint8_t type = mesh.types ? mesh.types[i] : mesh.surfaceType;
+      for (int y = yBegin; y <= yEnd; y++) {
+        for (int x = xBegin; x <= xEnd; x++) {
+          const uint64_t bits = getSurfaceBits(t, x, y);
+          if (!bits) continue;
+
+          opaqueMask[y * CS_P + x] |= bits;
+          const int zBegin = getFirstBit(bits);
+          BM_MEMSET(voxels + (y * CS_P + x) * CS_P + zBegin, type, getLastBit(bits) - zBegin + 1);
+        }
+      }
+    }
+
+    if (!mesh.fillType) continue;
+
+    // Column centres strictly inside the triangle's xy bounds
+    const int xFirst = (int) ceil(t.min[0] - 0.5) > 0 ? (int) ceil(t.min[0] - 0.5) : 0;
+    const int xLast = (int) floor(t.max[0] - 0.5) < CS_P - 1 ? (int) floor(t.max[0] - 0.5) : CS_P - 1;
+    const int yFirst = (int) ceil(t.min[1] - 0.5) > 0 ? (int) ceil(t.min[1] - 0.5) : 0;
+    const int yLast = (int) floor(t.max[1] - 0.5) < CS_P - 1 ? (int) floor(t.max[1] - 0.5) : CS_P - 1;
+    for (int y = yFirst; y <= yLast; y++) {
+      for (int x = xFirst; x <= xLast; x++) {
+        const uint64_t bit = getCrossingBit(t, x, y);
+        toggles[y * CS_P + x] ^= bit;
+        hasToggles |= bit != 0;
+      }
+    }
+  }
+
+  if (hasToggles) {
+    const uint64_t fill = mesh.fillType * 0x0101010101010101ull;
+
+    for (int i = 0; i < CS_P2; i++) {
+      uint64_t inside = toggles[i];
+      if (!inside) continue;
+
+      // Prefix XOR, bit z becomes the parity of the crossings below voxel z
+      inside ^= inside << 1;
+      inside ^= inside << 2;
+      inside ^= inside << 4;
+      inside ^= inside << 8;
+      inside ^= inside << 16;
+      inside ^= inside << 32;
+
+      const uint64_t interior = inside & ~opaqueMask[i];
+      opaqueMask[i] |= inside;
+
+      uint8_t* column = voxels + i * CS_P;
+      for (int z = 0; z < CS_P; z += 8) {
+        const uint64_t bytes = getByteMask(interior >> z);
+        if (!bytes) continue;
+
+        uint64_t current;
+        memcpy(&current, column + z, 8);
+        current = (current & ~bytes) | (fill & bytes);
+        memcpy(column + z, &current, 8);
+      }
+    }
+  }
+
+  for (int i = 0; i < CS_P2; i++) {
+    if (opaqueMask[i]) return true;
+  }
+  return false;
+}
+
+void voxelizeChunks(const VoxelizerMesh& mesh, const int* chunkPositions, int chunkCount,
+  uint8_t* const* voxels, uint64_t* const* opaqueMasks, int threadCount) {
+  std::atomic<int> next(0);
+  auto work = [&]() {
+    for (int i = next++; i < chunkCount; i = next++) {
+      voxelizeChunk(mesh, chunkPositions + i * 3, voxels[i], opaqueMasks[i]);
+    }
+  };
+
+  BM_VECTOR<std::thread> threads;
+  for (int i = 1; i < threadCount && i < chunkCount; i++) {
+    threads.emplace_back(work);
+  }
+  work();
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+}
+
+#endif // VOXELIZER_IMPLEMENTATION_H
+#endif // BM_IMPLEMENTATION